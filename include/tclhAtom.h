@@ -9,13 +9,55 @@
  */
 
 #include "tclhBase.h"
+#ifdef TCLH_ATOM_SHARED_POOL
+#include <stddef.h>
+#endif
 
 /* Section: Atoms
  *
  * Provides a facility to allow frequently used string values to be shared by
  * allocation of a single Tcl_Obj.
  *
+ * In addition to atoms looked up by string with <Tclh_AtomGet>, a fixed set
+ * of atoms may be declared at compile time by defining TCLH_STATIC_ATOMS
+ * before including this header. These are created once by
+ * <Tclh_AtomLibInit> and retrieved by their identifier with
+ * <Tclh_AtomById> without any hashing or string comparison.
+ *
+ * If TCLH_ATOM_SHARED_POOL is defined, the strings used as registry keys
+ * are stored once in a process-wide pool shared by the registries of all
+ * interpreters instead of being copied into each. Lookups of strings
+ * already in the pool do not take a lock. Pooled strings are only freed at
+ * process exit even if the atoms are freed by <Tclh_AtomSweep>, so the pool
+ * should only be enabled when the set of atomized strings is bounded. The
+ * pool size in buckets may be set by defining
+ * TCLH_ATOM_SHARED_POOL_BUCKETS as a power of 2.
+ */
+
+/* Macro: TCLH_STATIC_ATOMS
+ * Defined by the application to declare static atoms.
+ *
+ * The macro must take a single macro parameter and invoke it as
+ * X(ID, STRING) for each atom. For example,
+ *
+ * (start code)
+ * #define TCLH_STATIC_ATOMS(X) \
+ *     X(TAG, "Tag")            \
+ *     X(REGISTRATION, "Registration")
+ * (end code)
+ *
+ * This defines the enumeration <Tclh_AtomId> with members TCLH_ATOM_TAG
+ * and TCLH_ATOM_REGISTRATION for use with <Tclh_AtomById>, followed by
+ * TCLH_ATOM_COUNT.
  */
+#ifdef TCLH_STATIC_ATOMS
+# define TCLH_ATOM_ID_(id_, str_) TCLH_ATOM_##id_,
+typedef enum Tclh_AtomId {
+    TCLH_STATIC_ATOMS(TCLH_ATOM_ID_)
+    TCLH_ATOM_COUNT
+} Tclh_AtomId;
+# undef TCLH_ATOM_ID_
+#endif
 
 /* Function: Tclh_AtomLibInit
  * Must be called to initialize the Atom module before any of
@@ -28,7 +70,11 @@
  *    initialization if necessary.
  *
  * At least one of interp and tclhCtxP must be non-NULL.
- * 
+ *
+ * If TCLH_STATIC_ATOMS is defined, the static atoms are created as well.
+ * The static atoms are private to the extension even when the Tclh context
+ * is shared with other extensions that define their own static atoms.
+ *
  * Any allocated resources are automatically freed up when the interpreter
  * is deleted.
  *
@@ -66,9 +112,155 @@ TCLH_LOCAL Tclh_ReturnCode Tclh_AtomLibInit(Tcl_Interp *interp,
 TCLH_LOCAL Tcl_Obj *
 Tclh_AtomGet(Tcl_Interp *interp, Tclh_LibContext *ctx, const char *str);
 
+/* Function: Tclh_AtomGetN
+ * Returns a Tcl_Obj wrapping a length delimited string value.
+ *
+ * Parameters:
+ * interp - Tcl interpreter for error messages. May be NULL.
+ * tclhCtxP - Tclh context as returned by <Tclh_LibInit> to use. If NULL,
+ *    the Tclh context associated with the interpreter is used after
+ *    initialization if necessary.
+ * str - the string value to atomize. This need not be nul terminated.
+ * len - number of bytes in *str*. If negative, *str* must be nul
+ *    terminated.
+ *
+ * This is the same as <Tclh_AtomGet> except that the string is not
+ * required to be terminated and is not copied unless a new atom is
+ * created.
+ *
+ * Returns:
+ * Pointer to a Tcl_Obj containing the value. The function will panic on memory
+ * allocation failure.
+ */
+TCLH_LOCAL Tcl_Obj *Tclh_AtomGetN(Tcl_Interp *interp,
+                                  Tclh_LibContext *tclhCtxP,
+                                  const char *str,
+                                  Tcl_Size len);
+
+/* Function: Tclh_AtomFromObj
+ * Returns the atom for the string value of a Tcl_Obj.
+ *
+ * Parameters:
+ * interp - Tcl interpreter for error messages. May be NULL.
+ * tclhCtxP - Tclh context as returned by <Tclh_LibInit> to use. If NULL,
+ *    the Tclh context associated with the interpreter is used after
+ *    initialization if necessary.
+ * objP - the value to atomize
+ *
+ * If *objP* has no internal representation, the atom is cached in it so
+ * subsequent calls for the same Tcl_Obj do not look up the registry. Values
+ * with other internal representations, and atoms themselves including
+ * those of other registries, are looked up without modification.
+ * The reference rules for the returned Tcl_Obj are the same as for
+ * <Tclh_AtomGet>.
+ *
+ * Returns:
+ * Pointer to a Tcl_Obj containing the value. The function will panic on memory
+ * allocation failure.
+ */
+TCLH_LOCAL Tcl_Obj *Tclh_AtomFromObj(Tcl_Interp *interp,
+                                     Tclh_LibContext *tclhCtxP,
+                                     Tcl_Obj *objP);
+
+/* Typedef: Tclh_AtomStats
+ * Statistics for an atom registry returned by <Tclh_AtomGetStats>.
+ */
+typedef struct Tclh_AtomStats {
+    Tcl_Size count;         /* Number of atoms in the registry */
+    Tcl_Size peak;          /* Maximum number of atoms in the registry */
+    Tcl_Size limit;         /* Soft limit set by <Tclh_AtomSetLimit> */
+    Tcl_WideUInt hits;      /* Lookups that found an existing atom */
+    Tcl_WideUInt misses;    /* Lookups that created a new atom */
+    Tcl_WideUInt sweeps;    /* Number of sweeps */
+    Tcl_WideUInt reclaimed; /* Number of atoms freed by sweeps */
+} Tclh_AtomStats;
+
+/* Function: Tclh_AtomSetLimit
+ * Sets a soft limit on the number of atoms in the registry.
+ *
+ * Parameters:
+ * interp - Tcl interpreter for error messages. May be NULL.
+ * tclhCtxP - Tclh context as returned by <Tclh_LibInit> to use. If NULL,
+ *    the Tclh context associated with the interpreter is used.
+ * limit - the limit. If 0, there is no limit which is the default.
+ *
+ * When creating a new atom would take the registry over the limit, atoms
+ * that are referenced only by the registry are freed as for
+ * <Tclh_AtomSweep> except that atoms returned since the previous sweep
+ * are retained. If too few atoms can be freed, the registry is allowed to
+ * grow by half the limit before the next attempt.
+ *
+ * When a limit is set, callers must take a reference to any atom they
+ * hold on to across further atom lookups as described for <Tclh_AtomGet>.
+ *
+ * Returns:
+ * TCL_OK on success, TCL_ERROR with an error message in the interpreter.
+ */
+TCLH_LOCAL Tclh_ReturnCode Tclh_AtomSetLimit(Tcl_Interp *interp,
+                                             Tclh_LibContext *tclhCtxP,
+                                             Tcl_Size limit);
+
+/* Function: Tclh_AtomSweep
+ * Frees all atoms that are only referenced by the registry.
+ *
+ * Parameters:
+ * interp - Tcl interpreter for error messages. May be NULL.
+ * tclhCtxP - Tclh context as returned by <Tclh_LibInit> to use. If NULL,
+ *    the Tclh context associated with the interpreter is used.
+ *
+ * Atoms in use, i.e. those whose Tcl_Obj reference count shows other
+ * holders, static atoms and atoms cached by <Tclh_AtomFromObj> are
+ * retained.
+ *
+ * Returns:
+ * The number of atoms freed or -1 if the Atom module was not initialized.
+ */
+TCLH_LOCAL Tcl_Size Tclh_AtomSweep(Tcl_Interp *interp,
+                                   Tclh_LibContext *tclhCtxP);
+
+/* Function: Tclh_AtomGetStats
+ * Retrieves statistics for the atom registry.
+ *
+ * Parameters:
+ * interp - Tcl interpreter for error messages. May be NULL.
+ * tclhCtxP - Tclh context as returned by <Tclh_LibInit> to use. If NULL,
+ *    the Tclh context associated with the interpreter is used.
+ * statsP - location to store the statistics
+ *
+ * Returns:
+ * TCL_OK on success, TCL_ERROR with an error message in the interpreter.
+ */
+TCLH_LOCAL Tclh_ReturnCode Tclh_AtomGetStats(Tcl_Interp *interp,
+                                             Tclh_LibContext *tclhCtxP,
+                                             Tclh_AtomStats *statsP);
+
+#ifdef TCLH_STATIC_ATOMS
+/* Function: Tclh_AtomById
+ * Returns the Tcl_Obj for a static atom.
+ *
+ * Parameters:
+ * tclhCtxP - Tclh context as returned by <Tclh_LibInit>. Must not be NULL
+ *    and must have been initialized with <Tclh_AtomLibInit>.
+ * id - identifier of a static atom declared through <TCLH_STATIC_ATOMS>
+ *
+ * The same reference rules apply to the returned Tcl_Obj as for
+ * <Tclh_AtomGet>. Only available if TCLH_STATIC_ATOMS is defined.
+ *
+ * Returns:
+ * Pointer to the Tcl_Obj for the atom.
+ */
+TCLH_LOCAL Tcl_Obj *Tclh_AtomById(Tclh_LibContext *tclhCtxP, Tclh_AtomId id);
+#endif
+
 #ifdef TCLH_SHORTNAMES
 #define AtomLibInit Tclh_AtomLibInit
 #define AtomGet     Tclh_AtomGet
+#define AtomGetN    Tclh_AtomGetN
+#define AtomFromObj Tclh_AtomFromObj
+#define AtomSetLimit Tclh_AtomSetLimit
+#define AtomSweep   Tclh_AtomSweep
+#define AtomGetStats Tclh_AtomGetStats
+#define AtomById    Tclh_AtomById
 #endif
 
 #ifdef TCLH_IMPL
@@ -7,24 +7,442 @@
 
 #include "tclhAtom.h"
 
+#ifndef TCL_HASH_TYPE
+# define TCL_HASH_TYPE unsigned
+#endif
+
+/*
+ * The registry is keyed by length delimited strings so that atoms can be
+ * looked up without a nul terminated copy of the key. Lookups pass a
+ * TclhAtomKey pointing to the caller's bytes with the hash computed once
+ * up front. Entries hold their own copy allocated along with the entry or,
+ * if TCLH_ATOM_SHARED_POOL is defined, point into the shared string pool.
+ */
+typedef struct TclhAtomKey {
+    const char *bytes;
+    Tcl_Size len;
+    TCL_HASH_TYPE hash;
+} TclhAtomKey;
+
+/* Key as stored in a registry entry */
+typedef struct TclhAtomEntryKey {
+    TclhAtomKey key; /* Must be first */
+    int recent;      /* Atom returned since the last sweep */
+} TclhAtomEntryKey;
+
+struct TclhAtomRegistry {
+    Tcl_HashTable table;  /* Maps TclhAtomKey to atom Tcl_Obj */
+    size_t id;            /* Process-wide unique, never reused */
+    Tcl_Size limit;       /* Soft limit on number of atoms, 0 if none */
+    Tcl_Size sweepAt;     /* Sweep when number of atoms exceeds this */
+    Tclh_AtomStats stats; /* count and limit fields not maintained */
+};
+
+static TCL_HASH_TYPE
+TclhAtomHashBytes(const char *bytes, Tcl_Size len)
+{
+    const unsigned char *p = (const unsigned char *)bytes;
+    const unsigned char *end = p + len;
+    TCL_HASH_TYPE result = 0;
+
+    /* Same as Tcl's string hash */
+    while (p < end) {
+        result += (result << 3) + *p++;
+    }
+    return result;
+}
+
+static TCL_HASH_TYPE
+TclhAtomKeyHash(Tcl_HashTable *tablePtr, void *keyPtr)
+{
+    return ((const TclhAtomKey *)keyPtr)->hash;
+}
+
+#ifdef TCLH_ATOM_SHARED_POOL
+/*
+ * Process-wide pool of atom strings shared by the registries of all
+ * interpreters. Entries are immutable once published and are only freed
+ * at process exit. Lookups of existing strings do not take a lock. New
+ * entries are added under a mutex and published at the head of a bucket
+ * chain with a release store so readers never see a partially initialized
+ * entry. The bucket count is fixed since chains cannot be safely
+ * rehashed under lock-free readers.
+ */
+# ifndef TCLH_ATOM_SHARED_POOL_BUCKETS
+#  define TCLH_ATOM_SHARED_POOL_BUCKETS 4096 /* Must be a power of 2 */
+# endif
+
+# if defined(_MSC_VER)
+/* A compare exchange that never swaps is a load with a full barrier */
+#  define TCLH_ATOM_POOL_LOAD(p_) \
+      InterlockedCompareExchangePointer((PVOID volatile *)(p_), NULL, NULL)
+#  define TCLH_ATOM_POOL_STORE(p_, v_) \
+      InterlockedExchangePointer((PVOID volatile *)(p_), (v_))
+# else
+#  define TCLH_ATOM_POOL_LOAD(p_) __atomic_load_n((p_), __ATOMIC_ACQUIRE)
+#  define TCLH_ATOM_POOL_STORE(p_, v_) \
+      __atomic_store_n((p_), (v_), __ATOMIC_RELEASE)
+# endif
+
+typedef struct TclhAtomPoolEntry {
+    struct TclhAtomPoolEntry *nextP; /* Not modified once published */
+    TCL_HASH_TYPE hash;
+    Tcl_Size len;
+    char bytes[1]; /* Actual size len+1 */
+} TclhAtomPoolEntry;
+
+static TclhAtomPoolEntry *gTclhAtomPool[TCLH_ATOM_SHARED_POOL_BUCKETS];
+static int gTclhAtomPoolExitHandler;
+TCL_DECLARE_MUTEX(gTclhAtomPoolLock)
+
+static void
+TclhAtomPoolFinalize(ClientData clientData)
+{
+    int i;
+    Tcl_MutexLock(&gTclhAtomPoolLock);
+    for (i = 0; i < TCLH_ATOM_SHARED_POOL_BUCKETS; ++i) {
+        TclhAtomPoolEntry *entryP = gTclhAtomPool[i];
+        gTclhAtomPool[i] = NULL;
+        while (entryP) {
+            TclhAtomPoolEntry *nextP = entryP->nextP;
+            Tcl_Free((void *)entryP);
+            entryP = nextP;
+        }
+    }
+    gTclhAtomPoolExitHandler = 0;
+    Tcl_MutexUnlock(&gTclhAtomPoolLock);
+}
+
+static const TclhAtomPoolEntry *
+TclhAtomPoolFind(TclhAtomPoolEntry **headPP, const TclhAtomKey *keyP)
+{
+    const TclhAtomPoolEntry *entryP;
+    for (entryP = (TclhAtomPoolEntry *)TCLH_ATOM_POOL_LOAD(headPP);
+         entryP != NULL;
+         entryP = entryP->nextP) {
+        if (entryP->hash == keyP->hash && entryP->len == keyP->len
+            && memcmp(entryP->bytes, keyP->bytes, keyP->len) == 0)
+            return entryP;
+    }
+    return NULL;
+}
+
+/* Returns the pooled copy of a key's string, adding it if necessary */
+static const char *
+TclhAtomPoolIntern(const TclhAtomKey *keyP)
+{
+    TclhAtomPoolEntry **headPP =
+        &gTclhAtomPool[keyP->hash & (TCLH_ATOM_SHARED_POOL_BUCKETS - 1)];
+    const TclhAtomPoolEntry *foundP;
+    TclhAtomPoolEntry *entryP;
+
+    foundP = TclhAtomPoolFind(headPP, keyP);
+    if (foundP)
+        return foundP->bytes;
+
+    Tcl_MutexLock(&gTclhAtomPoolLock);
+    /* Another thread may have added it before we got the lock */
+    foundP = TclhAtomPoolFind(headPP, keyP);
+    if (foundP == NULL) {
+        entryP = (TclhAtomPoolEntry *)Tcl_Alloc(
+            offsetof(TclhAtomPoolEntry, bytes) + keyP->len + 1);
+        entryP->nextP = (TclhAtomPoolEntry *)TCLH_ATOM_POOL_LOAD(headPP);
+        entryP->hash  = keyP->hash;
+        entryP->len   = keyP->len;
+        memcpy(entryP->bytes, keyP->bytes, keyP->len);
+        entryP->bytes[keyP->len] = '\0';
+        TCLH_ATOM_POOL_STORE(headPP, entryP);
+        if (!gTclhAtomPoolExitHandler) {
+            Tcl_CreateExitHandler(TclhAtomPoolFinalize, NULL);
+            gTclhAtomPoolExitHandler = 1;
+        }
+        foundP = entryP;
+    }
+    Tcl_MutexUnlock(&gTclhAtomPoolLock);
+    return foundP->bytes;
+}
+#endif /* TCLH_ATOM_SHARED_POOL */
+
+static int
+TclhAtomKeyCompare(void *keyPtr, Tcl_HashEntry *hPtr)
+{
+    const TclhAtomKey *keyP = (const TclhAtomKey *)keyPtr;
+    const TclhAtomKey *entryKeyP = (const TclhAtomKey *)hPtr->key.oneWordValue;
+
+    return keyP->len == entryKeyP->len
+        && memcmp(keyP->bytes, entryKeyP->bytes, keyP->len) == 0;
+}
+
+static Tcl_HashEntry *
+TclhAtomKeyAlloc(Tcl_HashTable *tablePtr, void *keyPtr)
+{
+    const TclhAtomKey *keyP = (const TclhAtomKey *)keyPtr;
+    Tcl_HashEntry *hPtr;
+    TclhAtomEntryKey *entryKeyP;
+
+#ifdef TCLH_ATOM_SHARED_POOL
+    hPtr = (Tcl_HashEntry *)Tcl_Alloc(sizeof(*hPtr) + sizeof(*entryKeyP));
+    entryKeyP = (TclhAtomEntryKey *)(hPtr + 1);
+    entryKeyP->key.bytes    = TclhAtomPoolIntern(keyP);
+#else
+    char *bytes;
+    hPtr = (Tcl_HashEntry *)Tcl_Alloc(sizeof(*hPtr) + sizeof(*entryKeyP)
+                                      + keyP->len + 1);
+    entryKeyP = (TclhAtomEntryKey *)(hPtr + 1);
+    bytes     = (char *)(entryKeyP + 1);
+    memcpy(bytes, keyP->bytes, keyP->len);
+    bytes[keyP->len]        = '\0';
+    entryKeyP->key.bytes    = bytes;
+#endif
+    entryKeyP->key.len      = keyP->len;
+    entryKeyP->key.hash     = keyP->hash;
+    entryKeyP->recent       = 1;
+    hPtr->key.oneWordValue  = (char *)entryKeyP;
+    hPtr->clientData        = NULL;
+    return hPtr;
+}
+
+static const Tcl_HashKeyType gTclhAtomKeyType = {
+    TCL_HASH_KEY_TYPE_VERSION,
+    0,
+    TclhAtomKeyHash,
+    TclhAtomKeyCompare,
+    TclhAtomKeyAlloc,
+    NULL, /* Default free is sufficient as key is part of the entry */
+};
+
+/*
+ * Tcl_Obj type caching the atom for a string value. ptr1 holds a
+ * reference to the atom Tcl_Obj. ptr2 is the id of the registry it came
+ * from. The id is used in preference to the registry address as the
+ * latter may be reused by a new registry after the original is freed.
+ *
+ * The atoms held by registries are themselves marked with this type with
+ * ptr1 pointing to the atom itself without a reference. This identifies
+ * them as atoms so that an atom from one registry is never cached in an
+ * atom of another. Doing so could create reference cycles between atoms
+ * which would then never be freed.
+ */
+static void FreeAtomType(Tcl_Obj *objP);
+static void DupAtomType(Tcl_Obj *srcP, Tcl_Obj *dstP);
+static void UpdateAtomTypeString(Tcl_Obj *objP);
+static struct Tcl_ObjType gAtomType = {
+    "Tclh_Atom",
+    FreeAtomType,
+    DupAtomType,
+    UpdateAtomTypeString,
+    NULL,
+};
+TCLH_INLINE Tcl_Obj *IntrepGetAtom(Tcl_Obj *objP) {
+    return (Tcl_Obj *)objP->internalRep.twoPtrValue.ptr1;
+}
+TCLH_INLINE size_t IntrepGetAtomRegistryId(Tcl_Obj *objP) {
+    return (size_t)(uintptr_t)objP->internalRep.twoPtrValue.ptr2;
+}
+TCLH_INLINE int IntrepIsRegistryAtom(Tcl_Obj *objP) {
+    return objP->typePtr == &gAtomType && IntrepGetAtom(objP) == objP;
+}
+TCLH_INLINE void
+IntrepSetAtom(Tcl_Obj *objP, Tcl_Obj *atomObj, size_t registryId)
+{
+    /* An atom marking itself does not hold a reference, see above */
+    if (atomObj != objP)
+        Tcl_IncrRefCount(atomObj);
+    objP->internalRep.twoPtrValue.ptr1 = atomObj;
+    objP->internalRep.twoPtrValue.ptr2 = (void *)(uintptr_t)registryId;
+    objP->typePtr = &gAtomType;
+}
+
+static void
+FreeAtomType(Tcl_Obj *objP)
+{
+    if (!IntrepIsRegistryAtom(objP))
+        Tcl_DecrRefCount(IntrepGetAtom(objP));
+    objP->internalRep.twoPtrValue.ptr1 = NULL;
+    objP->internalRep.twoPtrValue.ptr2 = NULL;
+    objP->typePtr = NULL;
+}
+
+static void
+DupAtomType(Tcl_Obj *srcP, Tcl_Obj *dstP)
+{
+    /* The copy of a registry atom is not itself an atom so takes a ref */
+    IntrepSetAtom(dstP, IntrepGetAtom(srcP), IntrepGetAtomRegistryId(srcP));
+}
+
+static void
+UpdateAtomTypeString(Tcl_Obj *objP)
+{
+    Tcl_Size len;
+    const char *s = Tcl_GetStringFromObj(IntrepGetAtom(objP), &len);
+    objP->bytes = Tcl_Alloc(len + 1);
+    memcpy(objP->bytes, s, len + 1);
+    objP->length = len;
+}
+
+static size_t gTclhAtomRegistryLastId;
+TCL_DECLARE_MUTEX(gTclhAtomRegistryIdLock)
+
 static void
 TclhCleanupAtomRegistry(ClientData clientData, Tcl_Interp *interp)
 {
-    Tcl_HashTable *registryP = (Tcl_HashTable *)clientData;
+    TclhAtomRegistry *registryP = (TclhAtomRegistry *)clientData;
     TCLH_ASSERT(registryP);
 
     Tcl_HashEntry *he;
     Tcl_HashSearch hSearch;
 
-    for (he = Tcl_FirstHashEntry(registryP, &hSearch); he != NULL;
+    for (he = Tcl_FirstHashEntry(&registryP->table, &hSearch); he != NULL;
          he = Tcl_NextHashEntry(&hSearch)) {
         Tcl_Obj *objP = (Tcl_Obj *)Tcl_GetHashValue(he);
         Tcl_DecrRefCount(objP);
     }
-    Tcl_DeleteHashTable(registryP);
+    Tcl_DeleteHashTable(&registryP->table);
     Tcl_Free((void *)registryP);
 }
 
+/*
+ * Frees atoms only referenced by the registry. Unless *full* is set, atoms
+ * returned since the previous sweep are retained to give callers a chance
+ * to take a reference. Returns the number of atoms freed.
+ */
+static Tcl_Size
+TclhAtomRegistrySweep(TclhAtomRegistry *registryP, int full)
+{
+    Tcl_HashEntry *he;
+    Tcl_HashSearch hSearch;
+    Tcl_Size nfreed = 0;
+
+    for (he = Tcl_FirstHashEntry(&registryP->table, &hSearch); he != NULL;
+         he = Tcl_NextHashEntry(&hSearch)) {
+        Tcl_Obj *objP = (Tcl_Obj *)Tcl_GetHashValue(he);
+        TclhAtomEntryKey *entryKeyP =
+            (TclhAtomEntryKey *)Tcl_GetHashKey(&registryP->table, he);
+        if (objP->refCount == 1 && (full || !entryKeyP->recent)) {
+            /* Deleting the entry just returned by the search is permitted */
+            Tcl_DeleteHashEntry(he);
+            Tcl_DecrRefCount(objP);
+            ++nfreed;
+        } else {
+            entryKeyP->recent = 0;
+        }
+    }
+    registryP->stats.sweeps++;
+    registryP->stats.reclaimed += nfreed;
+
+    /*
+     * If most atoms are still in use, let the registry grow by half the
+     * limit before the next sweep so sweeps are amortized over insertions.
+     */
+    if (registryP->limit == 0) {
+        registryP->sweepAt = TCL_SIZE_MAX;
+    } else {
+        registryP->sweepAt = registryP->table.numEntries + registryP->limit / 2;
+        if (registryP->sweepAt < registryP->limit)
+            registryP->sweepAt = registryP->limit;
+    }
+    return nfreed;
+}
+
+#ifdef TCLH_STATIC_ATOMS
+
+# define TCLH_ATOM_STRING_(id_, str_) str_,
+static const char *const gTclhStaticAtomStrings[] = {
+    TCLH_STATIC_ATOMS(TCLH_ATOM_STRING_)
+};
+# undef TCLH_ATOM_STRING_
+
+/*
+ * The static atom table is specific to each compiled copy of the library
+ * whereas the Tclh context may be shared with other extensions. The atoms
+ * are therefore kept in interpreter assoc data under a key unique to this
+ * copy. The table last used by each thread is cached to avoid the assoc
+ * data lookup in Tclh_AtomById.
+ */
+typedef struct TclhStaticAtoms {
+    Tcl_Interp *interp;
+    Tcl_Obj *objs[TCLH_ATOM_COUNT]; /* Each holds a reference */
+} TclhStaticAtoms;
+
+typedef struct TclhStaticAtomsTsd {
+    TclhStaticAtoms *lastP; /* Table last looked up in this thread */
+} TclhStaticAtomsTsd;
+static Tcl_ThreadDataKey gTclhStaticAtomsTsdKey;
+
+/* buf must be at least 100 bytes */
+static const char *
+TclhStaticAtomsKey(char *buf)
+{
+    /* The table address distinguishes copies with the same embedder name */
+    snprintf(buf,
+             100,
+             "%.40s.TclhStaticAtoms.%p",
+             TCLH_EMBEDDER,
+             (void *)gTclhStaticAtomStrings);
+    return buf;
+}
+
+static void
+TclhCleanupStaticAtoms(ClientData clientData, Tcl_Interp *interp)
+{
+    TclhStaticAtoms *atomsP = (TclhStaticAtoms *)clientData;
+    TclhStaticAtomsTsd *tsdP;
+    int i;
+
+    /* Assoc data is deleted in the interpreter's thread */
+    tsdP = (TclhStaticAtomsTsd *)Tcl_GetThreadData(&gTclhStaticAtomsTsdKey,
+                                                   sizeof(*tsdP));
+    if (tsdP->lastP == atomsP)
+        tsdP->lastP = NULL;
+    for (i = 0; i < TCLH_ATOM_COUNT; ++i)
+        Tcl_DecrRefCount(atomsP->objs[i]);
+    Tcl_Free((void *)atomsP);
+}
+
+static Tclh_ReturnCode
+TclhInitStaticAtoms(Tcl_Interp *interp, Tclh_LibContext *tclhCtxP)
+{
+    TclhStaticAtoms *atomsP;
+    char key[100];
+    int i;
+
+    TclhStaticAtomsKey(key);
+    if (Tcl_GetAssocData(tclhCtxP->interp, key, NULL))
+        return TCL_OK; /* Already done */
+
+    atomsP = (TclhStaticAtoms *)Tcl_Alloc(sizeof(*atomsP));
+    atomsP->interp = tclhCtxP->interp;
+    for (i = 0; i < TCLH_ATOM_COUNT; ++i) {
+        /* Share the registry's Tcl_Obj and hold our own reference */
+        atomsP->objs[i] =
+            Tclh_AtomGet(interp, tclhCtxP, gTclhStaticAtomStrings[i]);
+        Tcl_IncrRefCount(atomsP->objs[i]);
+    }
+    Tcl_SetAssocData(tclhCtxP->interp, key, TclhCleanupStaticAtoms, atomsP);
+    return TCL_OK;
+}
+
+Tcl_Obj *
+Tclh_AtomById(Tclh_LibContext *tclhCtxP, Tclh_AtomId id)
+{
+    TclhStaticAtomsTsd *tsdP;
+    TclhStaticAtoms *atomsP;
+
+    TCLH_ASSERT(id >= 0 && id < TCLH_ATOM_COUNT);
+    tsdP = (TclhStaticAtomsTsd *)Tcl_GetThreadData(&gTclhStaticAtomsTsdKey,
+                                                   sizeof(*tsdP));
+    atomsP = tsdP->lastP;
+    if (atomsP == NULL || atomsP->interp != tclhCtxP->interp) {
+        char key[100];
+        atomsP = (TclhStaticAtoms *)Tcl_GetAssocData(
+            tclhCtxP->interp, TclhStaticAtomsKey(key), NULL);
+        TCLH_ASSERT(atomsP);
+        tsdP->lastP = atomsP;
+    }
+    return atomsP->objs[id];
+}
+#endif /* TCLH_STATIC_ATOMS */
+
 Tclh_ReturnCode
 Tclh_AtomLibInit(Tcl_Interp *interp, Tclh_LibContext *tclhCtxP)
 {
@@ -38,20 +456,37 @@ Tclh_AtomLibInit(Tcl_Interp *interp, Tclh_LibContext *tclhCtxP)
             return ret;
     }
 
-    if (tclhCtxP->atomRegistryP)
-        return TCL_OK; /* Already done */
-
-    Tcl_HashTable *htP =
-        (Tcl_HashTable *)Tcl_Alloc(sizeof(*tclhCtxP->atomRegistryP));
-    Tcl_InitHashTable(htP, TCL_STRING_KEYS);
-    Tcl_CallWhenDeleted(interp, TclhCleanupAtomRegistry, htP);
-    tclhCtxP->atomRegistryP = htP;
+    if (tclhCtxP->atomRegistryP == NULL) {
+        TclhAtomRegistry *registryP =
+            (TclhAtomRegistry *)Tcl_Alloc(sizeof(*tclhCtxP->atomRegistryP));
+        Tcl_InitCustomHashTable(
+            &registryP->table, TCL_CUSTOM_PTR_KEYS, &gTclhAtomKeyType);
+        Tcl_MutexLock(&gTclhAtomRegistryIdLock);
+        registryP->id = ++gTclhAtomRegistryLastId;
+        Tcl_MutexUnlock(&gTclhAtomRegistryIdLock);
+        registryP->limit   = 0;
+        registryP->sweepAt = TCL_SIZE_MAX;
+        memset(&registryP->stats, 0, sizeof(registryP->stats));
+        Tcl_CallWhenDeleted(interp, TclhCleanupAtomRegistry, registryP);
+        tclhCtxP->atomRegistryP = registryP;
+    }
 
+#ifdef TCLH_STATIC_ATOMS
+    return TclhInitStaticAtoms(interp, tclhCtxP);
+#else
     return TCL_OK;
+#endif
 }
 
 Tcl_Obj *
 Tclh_AtomGet(Tcl_Interp *interp, Tclh_LibContext *tclhCtxP, const char *str)
+{
+    return Tclh_AtomGetN(interp, tclhCtxP, str, -1);
+}
+
+/* Returns the registry for the context initializing the context if needed */
+static TclhAtomRegistry *
+TclhAtomGetRegistry(Tcl_Interp *interp, Tclh_LibContext *tclhCtxP)
 {
     Tclh_ReturnCode ret;
     if (tclhCtxP == NULL) {
@@ -66,16 +501,123 @@ Tclh_AtomGet(Tcl_Interp *interp, Tclh_LibContext *tclhCtxP, const char *str)
             interp, NULL, "Internal error: Tclh context not initialized.");
         return NULL;
     }
-    Tcl_HashTable *htP = tclhCtxP->atomRegistryP;
+    return tclhCtxP->atomRegistryP;
+}
+
+static Tcl_Obj *
+TclhAtomLookup(TclhAtomRegistry *registryP, const char *str, Tcl_Size len)
+{
     Tcl_HashEntry *he;
+    TclhAtomKey key;
     int new_entry;
-    he = Tcl_CreateHashEntry(htP, str, &new_entry);
+
+    key.bytes = str;
+    key.len   = len;
+    key.hash  = TclhAtomHashBytes(str, len);
+    he = Tcl_CreateHashEntry(&registryP->table, (char *)&key, &new_entry);
     if (new_entry) {
-        Tcl_Obj *objP = Tcl_NewStringObj(str, -1);
+        Tcl_Obj *objP = Tcl_NewStringObj(str, len);
         Tcl_IncrRefCount(objP);
+        IntrepSetAtom(objP, objP, registryP->id);
         Tcl_SetHashValue(he, objP);
+        registryP->stats.misses++;
+        if (registryP->table.numEntries > registryP->stats.peak)
+            registryP->stats.peak = registryP->table.numEntries;
+        /* New entry is marked recent so the sweep will not free it */
+        if (registryP->table.numEntries > registryP->sweepAt)
+            TclhAtomRegistrySweep(registryP, 0);
         return objP;
     } else {
+        TclhAtomEntryKey *entryKeyP =
+            (TclhAtomEntryKey *)Tcl_GetHashKey(&registryP->table, he);
+        entryKeyP->recent = 1;
+        registryP->stats.hits++;
         return (Tcl_Obj *) Tcl_GetHashValue(he);
     }
-}
\ No newline at end of file
+}
+
+Tcl_Obj *
+Tclh_AtomGetN(Tcl_Interp *interp,
+              Tclh_LibContext *tclhCtxP,
+              const char *str,
+              Tcl_Size len)
+{
+    TclhAtomRegistry *registryP = TclhAtomGetRegistry(interp, tclhCtxP);
+    if (registryP == NULL)
+        return NULL;
+    if (len < 0)
+        len = (Tcl_Size) strlen(str);
+    return TclhAtomLookup(registryP, str, len);
+}
+
+Tcl_Obj *
+Tclh_AtomFromObj(Tcl_Interp *interp, Tclh_LibContext *tclhCtxP, Tcl_Obj *objP)
+{
+    TclhAtomRegistry *registryP;
+    Tcl_Obj *atomObj;
+    const char *str;
+    Tcl_Size len;
+
+    registryP = TclhAtomGetRegistry(interp, tclhCtxP);
+    if (registryP == NULL)
+        return NULL;
+
+    if (objP->typePtr == &gAtomType
+        && IntrepGetAtomRegistryId(objP) == registryP->id)
+        return IntrepGetAtom(objP);
+
+    str     = Tcl_GetStringFromObj(objP, &len);
+    atomObj = TclhAtomLookup(registryP, str, len);
+
+    /*
+     * Only cache in values without an internal representation so as not to
+     * shimmer away a more useful one. Never cache in an atom, of this or
+     * any other registry, as that may create a reference cycle.
+     */
+    if (objP->typePtr == NULL
+        || (objP->typePtr == &gAtomType && !IntrepIsRegistryAtom(objP))) {
+        /* atomObj is safe from freeing here as the registry holds a ref */
+        if (objP->typePtr && objP->typePtr->freeIntRepProc)
+            objP->typePtr->freeIntRepProc(objP);
+        IntrepSetAtom(objP, atomObj, registryP->id);
+    }
+    return atomObj;
+}
+
+Tclh_ReturnCode
+Tclh_AtomSetLimit(Tcl_Interp *interp, Tclh_LibContext *tclhCtxP, Tcl_Size limit)
+{
+    TclhAtomRegistry *registryP = TclhAtomGetRegistry(interp, tclhCtxP);
+    if (registryP == NULL)
+        return TCL_ERROR;
+    if (limit < 0) {
+        return Tclh_ErrorInvalidValueStr(
+            interp, NULL, "Negative atom registry limit.");
+    }
+    registryP->limit   = limit;
+    registryP->sweepAt = limit ? limit : TCL_SIZE_MAX;
+    return TCL_OK;
+}
+
+Tcl_Size
+Tclh_AtomSweep(Tcl_Interp *interp, Tclh_LibContext *tclhCtxP)
+{
+    TclhAtomRegistry *registryP = TclhAtomGetRegistry(interp, tclhCtxP);
+    if (registryP == NULL)
+        return -1;
+    return TclhAtomRegistrySweep(registryP, 1);
+}
+
+Tclh_ReturnCode
+Tclh_AtomGetStats(Tcl_Interp *interp,
+                  Tclh_LibContext *tclhCtxP,
+                  Tclh_AtomStats *statsP)
+{
+    TclhAtomRegistry *registryP = TclhAtomGetRegistry(interp, tclhCtxP);
+    if (registryP == NULL)
+        return TCL_ERROR;
+    *statsP       = registryP->stats;
+    statsP->count = registryP->table.numEntries;
+    statsP->limit = registryP->limit;
+    return TCL_OK;
+}
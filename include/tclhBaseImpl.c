@@ -8,10 +8,11 @@
 #include "tclhBase.h"
 
 typedef struct TclhPointerRegistry TclhPointerRegistry;
+typedef struct TclhAtomRegistry TclhAtomRegistry;
 struct Tclh_LibContext {
     Tcl_Interp *interp;
     TclhPointerRegistry *pointerRegistryP; /* PointerLib */
-    Tcl_HashTable *atomRegistryP;          /* AtomLib */
+    TclhAtomRegistry *atomRegistryP;       /* AtomLib */
 #if defined(_WIN32)
     Tcl_Encoding encWinChar;               /* EncodingLib */
 #endif
@@ -20,8 +21,14 @@ struct Tclh_LibContext {
 char *TclhPrintAddress(const void *address, char *buf, int buflen);
 
 #ifndef TCLH_LIB_CONTEXT_NAME
-/* This will be shared for all extensions if embedder has not defined it */
-# define TCLH_LIB_CONTEXT_NAME "TclhLibContext"
+/*
+ * This will be shared for all extensions if embedder has not defined it.
+ * The name carries the layout version of Tclh_LibContext so that builds
+ * with incompatible layouts loaded into the same interpreter do not
+ * share a context. It must be changed whenever the layout changes.
+ * Version 2 changed atomRegistryP from a plain Tcl_HashTable.
+ */
+# define TCLH_LIB_CONTEXT_NAME "TclhLibContext2"
 #endif
 
 static void
@@ -9,6 +9,10 @@
  */
 
 #include "tclhBase.h"
+#include "tclhObj.h"
+#if defined(TCLH_ENABLE_CMD_STATS) && !defined(_WIN32)
+#include <time.h>
+#endif
 
 /* Section: Command implementation utilities
  * 
@@ -124,6 +128,240 @@ Tclh_SubCommandLookup(Tcl_Interp *ip,
                       Tcl_Obj *const objv[],
                       int *indexP);
 
+/* Function: Tclh_CreateEnsembleFromTable
+ * Creates a namespace ensemble command from a subcommand table.
+ *
+ * Parameters:
+ * ip - the interpreter in which the command is to be created
+ * name - the name of the ensemble command. If not fully qualified, the
+ *   command is created in *defaultNs*
+ * defaultNs - the namespace for the command if *name* is not fully qualified.
+ *   If NULL, the current namespace is used.
+ * cmdTableP - pointer to the command table terminated by an entry whose
+ *   *cmdName* field is NULL. This must point to static storage as it is
+ *   referenced by the created commands.
+ * clientData - passed to the *cmdFn* implementation of every subcommand
+ *
+ * Each entry in the table is registered as a separate Tcl command in the
+ * namespace with the same fully qualified name as the ensemble, which is
+ * created if necessary, and the ensemble maps each subcommand name to the
+ * corresponding command. Unique prefixes of subcommands are accepted as
+ * for <Tclh_SubCommandLookup>. Unlike dispatching through
+ * <Tclh_SubCommandLookup>, the subcommand lookup is done by Tcl.
+ *
+ * The *cmdFn* field of each entry must be a *Tcl_ObjCmdProc*. It is only
+ * invoked after the number of arguments has been verified against the
+ * *minargs* and *maxargs* fields with *message* used in the error message
+ * as for <Tclh_SubCommandLookup>. As there, *objv[1]* passed to *cmdFn*
+ * is the subcommand and its arguments begin at *objv[2]*.
+ *
+ * If *TCLH_ENABLE_ENSEMBLE_COMPILE* is defined, the ensemble is also
+ * marked for compilation using a flag that is private to Tcl so the lookup
+ * is bound at compile time for call sites in compiled scripts.
+ *
+ * On failure, any commands and namespace created by the function are
+ * deleted.
+ *
+ * Returns:
+ * Returns a token representing the ensemble command on success and NULL
+ * on failure with an error message in the interpreter.
+ */
+TCLH_LOCAL Tcl_Command
+Tclh_CreateEnsembleFromTable(Tcl_Interp *ip,
+                             const char *name,
+                             const char *defaultNs,
+                             const Tclh_SubCommand *cmdTableP,
+                             ClientData clientData);
+
+/* Typedef: Tclh_NRSubCommand
+ *
+ * Defines the descriptor for a single subcommand implemented with Tcl's
+ * non-recursive evaluation engine (NRE). The layout is the same as
+ * <Tclh_SubCommand> except that *cmdFn* is typed. It is called from
+ * within a NRE callback and may schedule further work with
+ * *Tcl_NRAddCallback* or evaluate scripts with *Tcl_NREvalObj* instead of
+ * recursing on the C stack. Such subcommands may therefore yield when
+ * called inside a coroutine.
+ */
+typedef struct Tclh_NRSubCommand {
+    const char *cmdName;
+    int minargs;
+    int maxargs;
+    const char *message;
+    Tcl_ObjCmdProc *cmdFn;
+    int flags; /* Command specific usage */
+} Tclh_NRSubCommand;
+
+/* Function: Tclh_NRSubCommandLookup
+ * Looks up a NRE subcommand table and returns index of a matching entry
+ * after verifying number of arguments.
+ *
+ * Parameters:
+ * ip - Interpreter
+ * cmdTableP - pointer to command table
+ * objc - Number of elements in *objv*. Must be at least *1*.
+ * objv - Array of *Tcl_Obj* pointers as passed to Tcl commands. *objv[0]*
+ *        is expected to be the main command and *objv[1]* the subcommand.
+ * indexP - location to store index of matched entry
+ *
+ * This is identical to <Tclh_SubCommandLookup> except for the table type.
+ *
+ * Returns:
+ * *TCL_OK* on success with index of match stored in *indexP*; otherwise,
+ * *TCL_ERROR* with error message in *ip*.
+ */
+TCLH_LOCAL Tclh_ReturnCode
+Tclh_NRSubCommandLookup(Tcl_Interp *ip,
+                        const Tclh_NRSubCommand *cmdTableP,
+                        int objc,
+                        Tcl_Obj *const objv[],
+                        int *indexP);
+
+/* Function: Tclh_NRSubCommandDispatch
+ * Looks up a NRE subcommand table, verifies arguments and invokes the
+ * matching entry.
+ *
+ * Parameters:
+ * ip - Interpreter
+ * cmdTableP - pointer to command table
+ * clientData - passed to the *cmdFn* implementation of the entry
+ * objc - Number of elements in *objv*. Must be at least *1*.
+ * objv - Array of *Tcl_Obj* pointers as passed to Tcl commands. *objv[0]*
+ *        is expected to be the main command and *objv[1]* the subcommand.
+ *
+ * This must only be called from the NRE implementation of a command, for
+ * example one created with *Tcl_NRCreateCommand*, or from a NRE callback.
+ * The *cmdFn* of the matching entry is called directly and its return
+ * value returned to the NRE engine.
+ *
+ * Returns:
+ * The result of the subcommand or *TCL_ERROR* with an error message in
+ * *ip* if the lookup failed.
+ */
+TCLH_LOCAL Tclh_ReturnCode
+Tclh_NRSubCommandDispatch(Tcl_Interp *ip,
+                          const Tclh_NRSubCommand *cmdTableP,
+                          ClientData clientData,
+                          int objc,
+                          Tcl_Obj *const objv[]);
+
+/* Function: Tclh_NRCreateCommandFromTable
+ * Creates a NRE enabled command that dispatches to a subcommand table.
+ *
+ * Parameters:
+ * ip - the interpreter in which the command is to be created
+ * name - the name of the command. If not fully qualified, the command is
+ *   created in *defaultNs*
+ * defaultNs - the namespace for the command if *name* is not fully qualified.
+ *   If NULL, the current namespace is used.
+ * cmdTableP - pointer to the command table terminated by an entry whose
+ *   *cmdName* field is NULL. This must point to static storage as it is
+ *   referenced by the created command.
+ * clientData - passed to the *cmdFn* implementation of every subcommand
+ *
+ * The command is created with *Tcl_NRCreateCommand* and dispatches with
+ * <Tclh_NRSubCommandDispatch>. When invoked from a non-NRE context, Tcl
+ * runs it through *Tcl_NRCallObjProc*.
+ *
+ * Returns:
+ * Returns a token representing the created command on success and NULL
+ * on failure.
+ */
+TCLH_LOCAL Tcl_Command
+Tclh_NRCreateCommandFromTable(Tcl_Interp *ip,
+                              const char *name,
+                              const char *defaultNs,
+                              const Tclh_NRSubCommand *cmdTableP,
+                              ClientData clientData);
+
+/* Typedef: Tclh_SubCommandStats
+ * Holds call statistics for one entry in a <Tclh_SubCommand> table.
+ *
+ * An array of these with one element per table entry is passed to
+ * <Tclh_SubCommandDispatch>, normally as a static array alongside the
+ * table. The elements should be zero-initialized. Statistics are only
+ * collected if the TCLH_ENABLE_CMD_STATS preprocessor symbol is defined.
+ * Otherwise the array is not touched and no timing calls are made.
+ *
+ * Latencies are measured with a monotonic clock. Bucket *i* of
+ * *histogram* counts calls that took at least 2^i and less than 2^(i+1)
+ * nanoseconds with bucket 0 also counting calls under one nanosecond and
+ * the last bucket counting all longer calls.
+ *
+ * Updates are not synchronized so statistics for a table shared between
+ * threads are approximate.
+ */
+#define TCLH_CMD_STATS_NBUCKETS 32
+typedef struct Tclh_SubCommandStats {
+    Tcl_WideUInt ncalls;  /* Number of invocations */
+    Tcl_WideUInt nerrors; /* Number of invocations returning TCL_ERROR */
+    Tcl_WideUInt totalNs; /* Cumulative time in nanoseconds */
+    Tcl_WideUInt histogram[TCLH_CMD_STATS_NBUCKETS]; /* Latency buckets */
+} Tclh_SubCommandStats;
+
+/* Function: Tclh_SubCommandDispatch
+ * Looks up a subcommand table, verifies arguments and invokes the
+ * matching entry.
+ *
+ * Parameters:
+ * ip - Interpreter
+ * cmdTableP - pointer to command table
+ * statsP - array of statistics with one element for each entry in
+ *   *cmdTableP*. May be NULL. Ignored if TCLH_ENABLE_CMD_STATS is not
+ *   defined.
+ * clientData - passed to the *cmdFn* implementation of the entry
+ * objc - Number of elements in *objv*. Must be at least *1*.
+ * objv - Array of *Tcl_Obj* pointers as passed to Tcl commands. *objv[0]*
+ *        is expected to be the main command and *objv[1]* the subcommand.
+ *
+ * The subcommand is looked up as for <Tclh_SubCommandLookup> and the
+ * *cmdFn* field of the matching entry, which must be a *Tcl_ObjCmdProc*,
+ * is called with *clientData*, *ip*, *objc* and *objv*.
+ *
+ * Returns:
+ * The result of the subcommand or *TCL_ERROR* with an error message in
+ * *ip* if the lookup failed.
+ */
+TCLH_LOCAL Tclh_ReturnCode
+Tclh_SubCommandDispatch(Tcl_Interp *ip,
+                        const Tclh_SubCommand *cmdTableP,
+                        Tclh_SubCommandStats *statsP,
+                        ClientData clientData,
+                        int objc,
+                        Tcl_Obj *const objv[]);
+
+#ifdef TCLH_ENABLE_CMD_STATS
+/* Function: Tclh_SubCommandStatsObj
+ * Returns the statistics for a subcommand table as a Tcl dictionary.
+ *
+ * Parameters:
+ * cmdTableP - pointer to command table
+ * statsP - array of statistics as passed to <Tclh_SubCommandDispatch>
+ *
+ * The dictionary is keyed by subcommand name. Each value is a dictionary
+ * with keys *calls*, *errors*, *totalns* and *histogram*, the last being
+ * a list of the bucket counts. Only available if TCLH_ENABLE_CMD_STATS is
+ * defined.
+ *
+ * Returns:
+ * A Tcl dictionary with a zero reference count.
+ */
+TCLH_LOCAL Tcl_Obj *
+Tclh_SubCommandStatsObj(const Tclh_SubCommand *cmdTableP,
+                        const Tclh_SubCommandStats *statsP);
+#endif
+
+/*
+ * Compiled option lists used by <Tclh_ParseargsProc> are cached per thread,
+ * keyed by the string value of the option list, so that an option list is
+ * not recompiled when its Tcl_Obj has been shimmered to another type. The
+ * cache is cleared when it reaches TCLH_PARSEARGS_CACHE_MAX entries.
+ * Defining it as 0 disables the cache.
+ */
+#ifndef TCLH_PARSEARGS_CACHE_MAX
+# define TCLH_PARSEARGS_CACHE_MAX 256
+#endif
+
 Tcl_ObjCmdProc Tclh_ParseargsProc;
 
 /* Function: Tclh_MakeParseargsCmd
@@ -148,7 +386,127 @@ TCLH_INLINE Tcl_Command Tclh_MakeParseargsCmd(Tcl_Interp *ip, const char *name,
     return cmdToken;
 }
 
+/* Typedef: Tclh_ArgOptionType
+ * Type of an option parsed by <Tclh_ParseargsObjv>.
+ *
+ * TCLH_ARGOPT_SWITCH - option takes no value. The int field is set to 1
+ *     if the option is present.
+ * TCLH_ARGOPT_BOOL - option value is a boolean stored in an int field.
+ * TCLH_ARGOPT_INT - option value is an integer stored in a Tcl_WideInt
+ *     field. If *choices* is not NULL, the value must be numerically equal
+ *     to one of the integers listed. These are parsed as in Tcl 9, as
+ *     decimal unless prefixed with 0x, 0b or 0o. A leading 0 alone does
+ *     not denote octal.
+ * TCLH_ARGOPT_ARG - option value is stored as a Tcl_Obj * field. No
+ *     reference is added so the value is only valid as long as the objv[]
+ *     array passed in. If *choices* is not NULL, the value must be one of
+ *     the listed strings.
+ * TCLH_ARGOPT_SYM - option value is a symbol from *symbols* or an integer
+ *     and the corresponding integer is stored in a Tcl_WideInt field.
+ * TCLH_ARGOPT_RADIO - the option is a set of mutually exclusive switches
+ *     listed in *choices*. The *name* field is only used in error
+ *     messages. The int field is set to the index into *choices* of the
+ *     last switch present.
+ */
+typedef enum Tclh_ArgOptionType {
+    TCLH_ARGOPT_SWITCH,
+    TCLH_ARGOPT_BOOL,
+    TCLH_ARGOPT_INT,
+    TCLH_ARGOPT_ARG,
+    TCLH_ARGOPT_SYM,
+    TCLH_ARGOPT_RADIO
+} Tclh_ArgOptionType;
+
+/* Typedef: Tclh_ArgSymbol
+ * Maps a symbol to an integer for <TCLH_ARGOPT_SYM> options. A table of
+ * these is terminated by an entry with a NULL name.
+ */
+typedef struct Tclh_ArgSymbol {
+    const char *name;
+    Tcl_WideInt value;
+} Tclh_ArgSymbol;
+
+/* Typedef: Tclh_ArgOption
+ * Describes a single option for <Tclh_ParseargsObjv>.
+ */
+typedef struct Tclh_ArgOption {
+    const char *name;        /* Option name without the leading - */
+    Tclh_ArgOptionType type; /* Option type */
+    size_t offset;           /* Offset of the field in the options struct */
+    const char *const *choices;     /* NULL terminated array of permitted
+                                       values or radio switches. May be NULL
+                                       except for TCLH_ARGOPT_RADIO where
+                                       the entry then never matches. */
+    const Tclh_ArgSymbol *symbols;  /* Symbol table for TCLH_ARGOPT_SYM */
+} Tclh_ArgOption;
+
+/* Flags for Tclh_ParseargsObjv */
+#define TCLH_PARSEARGS_IGNORE_UNKNOWN 0x1
+
+/* Function: Tclh_ParseargsObjv
+ * Parses options from an argument array into a C struct.
+ *
+ * Parameters:
+ * interp - Interpreter for error messages. May be NULL.
+ * optTable - array of option descriptors, normally static
+ * nopts - number of elements in *optTable*
+ * objc - number of elements in *objv*
+ * objv - arguments to parse, not including the command name
+ * flags - a mask of TCLH_PARSEARGS_* flags
+ * maxLeftover - maximum number of arguments permitted after the options.
+ *   A negative value means no limit.
+ * structP - options struct into which values are stored at the offsets
+ *   given in *optTable*
+ * firstArgP - location to store the index of the first argument following
+ *   the options. May be NULL.
+ * unknownObjs - if not NULL, an array of at least *objc* elements in which
+ *   unrecognized options and their values are returned in order. No
+ *   references are added to the returned Tcl_Obj values. Only used if
+ *   TCLH_PARSEARGS_IGNORE_UNKNOWN is set.
+ * nunknownP - location to store the number of elements returned in
+ *   *unknownObjs*. Must not be NULL if *unknownObjs* is not NULL.
+ *
+ * This is the C equivalent of the script level parseargs command created
+ * with <Tclh_MakeParseargsCmd> with the same parsing rules but without
+ * going through Tcl variables and lists. Options end at the first argument
+ * not beginning with -, or at a - or -- argument which is skipped.
+ *
+ * Fields corresponding to options that are not present are not modified
+ * so default values should be set by initializing the struct before the
+ * call.
+ *
+ * If TCLH_PARSEARGS_IGNORE_UNKNOWN is set in *flags*, unrecognized options
+ * are skipped together with the following argument if that does not begin
+ * with -. As for the script level command, these are returned to the
+ * caller, here through *unknownObjs*, and are not counted against
+ * *maxLeftover*. The caller can construct the equivalent of the script
+ * level remaining arguments by following them with the elements of
+ * *objv* starting at the index returned in *firstArgP*.
+ *
+ * Returns:
+ * TCL_OK on success, TCL_ERROR with an error message in the interpreter.
+ * On error, the contents of the struct are undefined.
+ */
+TCLH_LOCAL Tclh_ReturnCode Tclh_ParseargsObjv(Tcl_Interp *interp,
+                                              const Tclh_ArgOption *optTable,
+                                              Tcl_Size nopts,
+                                              Tcl_Size objc,
+                                              Tcl_Obj *const objv[],
+                                              int flags,
+                                              Tcl_Size maxLeftover,
+                                              void *structP,
+                                              Tcl_Size *firstArgP,
+                                              Tcl_Obj **unknownObjs,
+                                              Tcl_Size *nunknownP);
+
 #ifdef TCLH_SHORTNAMES
+#define CreateEnsembleFromTable Tclh_CreateEnsembleFromTable
+#define SubCommandDispatch    Tclh_SubCommandDispatch
+#define NRSubCommandLookup    Tclh_NRSubCommandLookup
+#define NRSubCommandDispatch  Tclh_NRSubCommandDispatch
+#define NRCreateCommandFromTable Tclh_NRCreateCommandFromTable
+#define SubCommandStatsObj    Tclh_SubCommandStatsObj
+#define ParseargsObjv         Tclh_ParseargsObjv
 #define SubCommandNameToIndex Tclh_SubCommandNameToIndex
 #define SubCommandLookup      Tclh_SubCommandLookup
 #define MakeParseargsCmd      Tclh_MakeParseargsCmd
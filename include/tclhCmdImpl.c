@@ -6,6 +6,7 @@
  */
 
 #include "tclhCmd.h"
+#include <ctype.h>
 
 Tclh_ReturnCode
 Tclh_SubCommandNameToIndex(Tcl_Interp *ip,
@@ -18,31 +19,374 @@ Tclh_SubCommandNameToIndex(Tcl_Interp *ip,
 }
 
 
-Tclh_ReturnCode
-Tclh_SubCommandLookup(Tcl_Interp *ip,
-                      const Tclh_SubCommand *cmdTableP,
-                      int objc,
-                      Tcl_Obj *const objv[],
-                      int *indexP)
+/*
+ * Common implementation of Tclh_SubCommandLookup and
+ * Tclh_NRSubCommandLookup. Entries of both table types begin with the
+ * same name, minargs, maxargs and message fields and only differ in the
+ * type of cmdFn so they are accessed through Tclh_SubCommand.
+ */
+static Tclh_ReturnCode
+TclhSubCommandLookup(Tcl_Interp *ip,
+                     const void *cmdTableP,
+                     size_t entrySize,
+                     int objc,
+                     Tcl_Obj *const objv[],
+                     int *indexP)
 {
+    const Tclh_SubCommand *cmdP;
+
     if (objc < 2) {
         return Tclh_ErrorNumArgs(ip, 1, objv, "subcommand ?arg ...?");
     }
     if (Tcl_GetIndexFromObjStruct(
-            ip, objv[1], cmdTableP, sizeof(*cmdTableP), "subcommand", 0, indexP)
+            ip, objv[1], cmdTableP, (int)entrySize, "subcommand", 0, indexP)
         != TCL_OK)
         return TCL_ERROR;
 
-    cmdTableP += *indexP;
+    cmdP = (const Tclh_SubCommand *)((const char *)cmdTableP
+                                     + *indexP * entrySize);
     /*
      * Can't use CHECK_NARGS here because of slightly different semantics.
      */
-    if ((objc-2) < cmdTableP->minargs || (objc-2) > cmdTableP->maxargs) {
-        return Tclh_ErrorNumArgs(ip, 2, objv, cmdTableP->message);
+    if ((objc-2) < cmdP->minargs || (objc-2) > cmdP->maxargs) {
+        return Tclh_ErrorNumArgs(ip, 2, objv, cmdP->message);
     }
     return TCL_OK;
 }
 
+Tclh_ReturnCode
+Tclh_SubCommandLookup(Tcl_Interp *ip,
+                      const Tclh_SubCommand *cmdTableP,
+                      int objc,
+                      Tcl_Obj *const objv[],
+                      int *indexP)
+{
+    return TclhSubCommandLookup(
+        ip, cmdTableP, sizeof(*cmdTableP), objc, objv, indexP);
+}
+
+Tclh_ReturnCode
+Tclh_NRSubCommandLookup(Tcl_Interp *ip,
+                        const Tclh_NRSubCommand *cmdTableP,
+                        int objc,
+                        Tcl_Obj *const objv[],
+                        int *indexP)
+{
+    return TclhSubCommandLookup(
+        ip, cmdTableP, sizeof(*cmdTableP), objc, objv, indexP);
+}
+
+/* Command delete callback for commands whose client data is Tcl_Alloc'ed */
+static void
+TclhCmdFreeClientData(ClientData clientData)
+{
+    Tcl_Free((char *)clientData);
+}
+
+Tclh_ReturnCode
+Tclh_NRSubCommandDispatch(Tcl_Interp *ip,
+                          const Tclh_NRSubCommand *cmdTableP,
+                          ClientData clientData,
+                          int objc,
+                          Tcl_Obj *const objv[])
+{
+    int cmdIndex;
+
+    if (Tclh_NRSubCommandLookup(ip, cmdTableP, objc, objv, &cmdIndex)
+        != TCL_OK)
+        return TCL_ERROR;
+    return cmdTableP[cmdIndex].cmdFn(clientData, ip, objc, objv);
+}
+
+typedef struct TclhNRCommand {
+    const Tclh_NRSubCommand *cmdTableP; /* Subcommand table */
+    ClientData clientData;              /* Passed to subcommands */
+} TclhNRCommand;
+
+static int
+TclhNRCommandNRProc(ClientData clientData,
+                    Tcl_Interp *ip,
+                    int objc,
+                    Tcl_Obj *const objv[])
+{
+    TclhNRCommand *nrCmdP = (TclhNRCommand *)clientData;
+    return Tclh_NRSubCommandDispatch(
+        ip, nrCmdP->cmdTableP, nrCmdP->clientData, objc, objv);
+}
+
+static int
+TclhNRCommandProc(ClientData clientData,
+                  Tcl_Interp *ip,
+                  int objc,
+                  Tcl_Obj *const objv[])
+{
+    return Tcl_NRCallObjProc(ip, TclhNRCommandNRProc, clientData, objc, objv);
+}
+
+Tcl_Command
+Tclh_NRCreateCommandFromTable(Tcl_Interp *ip,
+                              const char *name,
+                              const char *defaultNs,
+                              const Tclh_NRSubCommand *cmdTableP,
+                              ClientData clientData)
+{
+    Tcl_DString ds;
+    Tcl_Command cmdToken;
+    TclhNRCommand *nrCmdP;
+
+    nrCmdP = (TclhNRCommand *)Tcl_Alloc(sizeof(*nrCmdP));
+    nrCmdP->cmdTableP  = cmdTableP;
+    nrCmdP->clientData = clientData;
+    cmdToken = Tcl_NRCreateCommand(ip,
+                                   Tclh_NsQualifyName(ip, name, -1, &ds, defaultNs),
+                                   TclhNRCommandProc,
+                                   TclhNRCommandNRProc,
+                                   nrCmdP,
+                                   TclhCmdFreeClientData);
+    Tcl_DStringFree(&ds); /* Irrespective of success/failure */
+    if (cmdToken == NULL)
+        Tcl_Free((char *)nrCmdP);
+    return cmdToken;
+}
+
+#ifdef TCLH_ENABLE_CMD_STATS
+/* Returns a monotonic time stamp in nanoseconds */
+static Tcl_WideUInt TclhCmdStatsNow(void)
+{
+#ifdef _WIN32
+    static LARGE_INTEGER freq;
+    LARGE_INTEGER count;
+    if (freq.QuadPart == 0)
+        QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&count);
+    /* Split to avoid overflow of count * 1e9 */
+    return (Tcl_WideUInt)(count.QuadPart / freq.QuadPart) * 1000000000u
+         + (Tcl_WideUInt)(count.QuadPart % freq.QuadPart) * 1000000000u
+               / freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (Tcl_WideUInt)ts.tv_sec * 1000000000u + ts.tv_nsec;
+#endif
+}
+
+static void
+TclhCmdStatsRecord(Tclh_SubCommandStats *statP,
+                   Tcl_WideUInt elapsed,
+                   int result)
+{
+    Tcl_WideUInt ns = elapsed;
+    int bucket = 0;
+    while ((ns >>= 1) != 0 && bucket < TCLH_CMD_STATS_NBUCKETS - 1)
+        ++bucket;
+    statP->ncalls++;
+    statP->totalNs += elapsed;
+    if (result == TCL_ERROR)
+        statP->nerrors++;
+    statP->histogram[bucket]++;
+}
+
+Tcl_Obj *
+Tclh_SubCommandStatsObj(const Tclh_SubCommand *cmdTableP,
+                        const Tclh_SubCommandStats *statsP)
+{
+    Tcl_Obj *resultObj = Tcl_NewDictObj();
+
+    for (; cmdTableP->cmdName; ++cmdTableP, ++statsP) {
+        Tcl_Obj *objs[8];
+        Tcl_Obj *histObjs[TCLH_CMD_STATS_NBUCKETS];
+        int i;
+        for (i = 0; i < TCLH_CMD_STATS_NBUCKETS; ++i)
+            histObjs[i] = Tclh_ObjFromULongLong(statsP->histogram[i]);
+        objs[0] = Tcl_NewStringObj("calls", 5);
+        objs[1] = Tclh_ObjFromULongLong(statsP->ncalls);
+        objs[2] = Tcl_NewStringObj("errors", 6);
+        objs[3] = Tclh_ObjFromULongLong(statsP->nerrors);
+        objs[4] = Tcl_NewStringObj("totalns", 7);
+        objs[5] = Tclh_ObjFromULongLong(statsP->totalNs);
+        objs[6] = Tcl_NewStringObj("histogram", 9);
+        objs[7] = Tcl_NewListObj(TCLH_CMD_STATS_NBUCKETS, histObjs);
+        Tcl_DictObjPut(NULL,
+                       resultObj,
+                       Tcl_NewStringObj(cmdTableP->cmdName, -1),
+                       Tcl_NewListObj(8, objs));
+    }
+    return resultObj;
+}
+#endif /* TCLH_ENABLE_CMD_STATS */
+
+Tclh_ReturnCode
+Tclh_SubCommandDispatch(Tcl_Interp *ip,
+                        const Tclh_SubCommand *cmdTableP,
+                        Tclh_SubCommandStats *statsP,
+                        ClientData clientData,
+                        int objc,
+                        Tcl_Obj *const objv[])
+{
+    int cmdIndex;
+    Tcl_ObjCmdProc *cmdFn;
+
+    if (Tclh_SubCommandLookup(ip, cmdTableP, objc, objv, &cmdIndex) != TCL_OK)
+        return TCL_ERROR;
+    cmdFn = (Tcl_ObjCmdProc *)cmdTableP[cmdIndex].cmdFn;
+
+#ifdef TCLH_ENABLE_CMD_STATS
+    if (statsP) {
+        Tcl_WideUInt start = TclhCmdStatsNow();
+        int result = cmdFn(clientData, ip, objc, objv);
+        TclhCmdStatsRecord(
+            &statsP[cmdIndex], TclhCmdStatsNow() - start, result);
+        return result;
+    }
+#else
+    (void)statsP;
+#endif
+    return cmdFn(clientData, ip, objc, objv);
+}
+
+#ifdef TCLH_ENABLE_ENSEMBLE_COMPILE
+/*
+ * Tcl's ENSEMBLE_COMPILE flag from tclInt.h. It is not in the public
+ * headers but is accepted by Tcl_SetEnsembleFlags and enables compilation
+ * of ensemble invocations into direct calls of the mapped command. Being
+ * private to Tcl, it is only used if the embedder opts in.
+ */
+#define TCLH_ENSEMBLE_FLAGS (TCL_ENSEMBLE_PREFIX | 0x4)
+#else
+#define TCLH_ENSEMBLE_FLAGS TCL_ENSEMBLE_PREFIX
+#endif
+
+typedef struct TclhEnsembleSubCommand {
+    const Tclh_SubCommand *cmdP; /* Entry in the subcommand table */
+    ClientData clientData;       /* Passed to cmdP->cmdFn */
+} TclhEnsembleSubCommand;
+
+static int
+TclhEnsembleSubCommandProc(ClientData clientData,
+                           Tcl_Interp *ip,
+                           int objc,
+                           Tcl_Obj *const objv[])
+{
+    TclhEnsembleSubCommand *subP = (TclhEnsembleSubCommand *)clientData;
+    const Tclh_SubCommand *cmdP = subP->cmdP;
+
+    /*
+     * The mapping inserts the subcommand name after the implementing
+     * command so objv[1] is the subcommand as for Tclh_SubCommandLookup.
+     * Tcl rewrites wrong#args messages to show the ensemble command.
+     */
+    if ((objc-2) < cmdP->minargs || (objc-2) > cmdP->maxargs) {
+        return Tclh_ErrorNumArgs(ip, 2, objv, cmdP->message);
+    }
+    return ((Tcl_ObjCmdProc *)cmdP->cmdFn)(subP->clientData, ip, objc, objv);
+}
+
+Tcl_Command
+Tclh_CreateEnsembleFromTable(Tcl_Interp *ip,
+                             const char *name,
+                             const char *defaultNs,
+                             const Tclh_SubCommand *cmdTableP,
+                             ClientData clientData)
+{
+    Tcl_DString ds;
+    const char *fqn;
+    Tcl_Namespace *nsP;
+    Tcl_Command ensembleToken = NULL;
+    Tcl_Command *implTokens;
+    Tcl_Obj *mapObj;
+    Tcl_Obj *subcmdsObj;
+    Tcl_Obj *fqnObj;
+    const Tclh_SubCommand *cmdP;
+    int i, ncmds;
+    int createdNs       = 0;
+    int createdEnsemble = 0;
+
+    fqn = Tclh_NsQualifyName(ip, name, -1, &ds, defaultNs);
+
+    nsP = Tcl_FindNamespace(ip, fqn, NULL, 0);
+    if (nsP == NULL) {
+        nsP = Tcl_CreateNamespace(ip, fqn, NULL, NULL);
+        if (nsP == NULL)
+            goto vamoose;
+        createdNs = 1;
+    }
+
+    /* Commands created so far are tracked so they can be undone on error */
+    for (ncmds = 0; cmdTableP[ncmds].cmdName; ++ncmds)
+        ;
+    implTokens = (Tcl_Command *)Tcl_Alloc((ncmds + 1) * sizeof(Tcl_Command));
+    ncmds      = 0;
+
+    mapObj     = Tcl_NewDictObj();
+    subcmdsObj = Tcl_NewListObj(0, NULL);
+    Tcl_IncrRefCount(mapObj);
+    Tcl_IncrRefCount(subcmdsObj);
+    for (cmdP = cmdTableP; cmdP->cmdName; ++cmdP) {
+        TclhEnsembleSubCommand *subP;
+        Tcl_Obj *subcmdObj;
+        Tcl_Obj *targetObjs[2];
+
+        subP = (TclhEnsembleSubCommand *)Tcl_Alloc(sizeof(*subP));
+        subP->cmdP       = cmdP;
+        subP->clientData = clientData;
+        targetObjs[0] = Tcl_ObjPrintf(
+            "%s::%s", Tclh_NsIsGlobalNs(fqn) ? "" : fqn, cmdP->cmdName);
+        Tcl_IncrRefCount(targetObjs[0]);
+        implTokens[ncmds] = Tcl_CreateObjCommand(ip,
+                                                 Tcl_GetString(targetObjs[0]),
+                                                 TclhEnsembleSubCommandProc,
+                                                 subP,
+                                                 TclhCmdFreeClientData);
+        if (implTokens[ncmds] == NULL) {
+            Tcl_Free((char *)subP);
+            Tcl_DecrRefCount(targetObjs[0]);
+            goto cleanup;
+        }
+        ++ncmds;
+        subcmdObj     = Tcl_NewStringObj(cmdP->cmdName, -1);
+        targetObjs[1] = subcmdObj;
+        Tcl_ListObjAppendElement(NULL, subcmdsObj, subcmdObj);
+        /* Map to {fqn::sub sub} so objv[1] is the subcommand name */
+        Tcl_DictObjPut(NULL, mapObj, subcmdObj, Tcl_NewListObj(2, targetObjs));
+        Tcl_DecrRefCount(targetObjs[0]);
+    }
+
+    /* Reuse an existing ensemble, e.g. when the table is registered again */
+    fqnObj = Tcl_NewStringObj(fqn, -1);
+    Tcl_IncrRefCount(fqnObj);
+    ensembleToken = Tcl_FindEnsemble(ip, fqnObj, 0);
+    Tcl_DecrRefCount(fqnObj);
+    if (ensembleToken == NULL) {
+        ensembleToken = Tcl_CreateEnsemble(ip, fqn, nsP, TCL_ENSEMBLE_PREFIX);
+        if (ensembleToken == NULL)
+            goto cleanup;
+        createdEnsemble = 1;
+    }
+    if (Tcl_SetEnsembleSubcommandList(ip, ensembleToken, subcmdsObj) != TCL_OK
+        || Tcl_SetEnsembleMappingDict(ip, ensembleToken, mapObj) != TCL_OK
+        || Tcl_SetEnsembleFlags(ip, ensembleToken, TCLH_ENSEMBLE_FLAGS)
+               != TCL_OK) {
+        if (createdEnsemble)
+            Tcl_DeleteCommandFromToken(ip, ensembleToken);
+        ensembleToken = NULL;
+    }
+
+cleanup:
+    if (ensembleToken == NULL) {
+        /* Undo whatever was created. The error message is left intact. */
+        for (i = 0; i < ncmds; ++i)
+            Tcl_DeleteCommandFromToken(ip, implTokens[i]);
+        if (createdNs)
+            Tcl_DeleteNamespace(nsP);
+    }
+    Tcl_Free((char *)implTokens);
+    Tcl_DecrRefCount(mapObj);
+    Tcl_DecrRefCount(subcmdsObj);
+vamoose:
+    Tcl_DStringFree(&ds);
+    return ensembleToken;
+}
+
 struct OptionDescriptor {
     Tcl_Obj    *name; // TBD - should this store name without the .type suffix?
     Tcl_Obj    *def_value;
@@ -56,10 +400,42 @@ struct OptionDescriptor {
 #define OPT_SWITCH 3
 #define OPT_SYM    4
 #define OPT_RADIO 5
-    char        first;          /* First char of name[] */
+    /*
+     * Compiled forms of valid_values. If NULL, valid_values is checked
+     * directly, e.g. when an OPT_INT enumeration has non-integer values.
+     */
+    Tcl_HashTable *valid_set;   /* OPT_ANY - set of valid strings */
+    Tcl_WideInt *valid_ints;    /* OPT_INT - sorted valid integers */
+    Tcl_Size     nvalid_ints;   /* Number of elements in valid_ints */
+    int          valid_is_range;/* OPT_INT - valid_ints form a contiguous
+                                   range so only bounds need checking */
 };
 
 
+/*
+ * Entry in the option lookup table of a compiled option list. Maps an
+ * option name, or a choice of a radio option, to the option descriptor.
+ */
+struct OptionMatch {
+    int      optIndex;          /* Index into option descriptor array */
+    Tcl_Obj *radioChoice;       /* Matched choice for OPT_RADIO, else NULL.
+                                   Holds a reference. */
+};
+
+/*
+ * Compiled option list. This is shared between a Tcl_Obj and its duplicates
+ * and is therefore reference counted.
+ */
+typedef struct ParseargsSpec {
+    int nRefs;                      /* Reference count */
+    int nopts;                      /* Number of elements in opts[] */
+    struct OptionDescriptor *opts;  /* Option descriptors */
+    int nmatches;                   /* Number of elements in matches[] */
+    struct OptionMatch *matches;    /* Storage for lookup entries */
+    Tcl_HashTable lookup;           /* Option names and radio choices ->
+                                       matches[] element */
+} ParseargsSpec;
+
 static int SetParseargsOptFromAny(Tcl_Interp *interp, Tcl_Obj *objP);
 static void DupParseargsOpt(Tcl_Obj *srcP, Tcl_Obj *dstP);
 static void FreeParseargsOpt(Tcl_Obj *objP);
@@ -72,6 +448,13 @@ static struct Tcl_ObjType gParseargsOptionType = {
     UpdateStringParseargsOpt,
     NULL,
 };
+TCLH_INLINE ParseargsSpec *IntrepGetParseargsSpec(Tcl_Obj *objP) {
+    return (ParseargsSpec *) objP->internalRep.twoPtrValue.ptr1;
+}
+TCLH_INLINE void IntrepSetParseargsSpec(Tcl_Obj *objP, ParseargsSpec *specP) {
+    objP->internalRep.twoPtrValue.ptr1 = (void *) specP;
+    objP->internalRep.twoPtrValue.ptr2 = NULL;
+}
 
 static void CleanupOptionDescriptor(struct OptionDescriptor *optP)
 {
@@ -87,18 +470,227 @@ static void CleanupOptionDescriptor(struct OptionDescriptor *optP)
         Tcl_DecrRefCount(optP->valid_values);
         optP->valid_values = NULL;
     }
+    if (optP->valid_set) {
+        Tcl_DeleteHashTable(optP->valid_set);
+        Tcl_Free((char *)optP->valid_set);
+        optP->valid_set = NULL;
+    }
+    if (optP->valid_ints) {
+        Tcl_Free((char *)optP->valid_ints);
+        optP->valid_ints = NULL;
+    }
+}
+
+static int CompareWideInts(const void *aP, const void *bP)
+{
+    Tcl_WideInt a = *(const Tcl_WideInt *)aP;
+    Tcl_WideInt b = *(const Tcl_WideInt *)bP;
+    return a < b ? -1 : (a > b);
+}
+
+/*
+ * Compiles the valid_values list of an option into a form that permits
+ * a single lookup during argument validation.
+ */
+static void CompileOptionValidValues(struct OptionDescriptor *optP,
+                                     Tcl_Size nvalid,
+                                     Tcl_Obj *const validObjs[])
+{
+    Tcl_Size i;
+
+    if (optP->type == OPT_ANY) {
+        optP->valid_set = (Tcl_HashTable *)Tcl_Alloc(sizeof(Tcl_HashTable));
+        Tcl_InitHashTable(optP->valid_set, TCL_STRING_KEYS);
+        for (i = 0; i < nvalid; ++i) {
+            int newEntry;
+            Tcl_CreateHashEntry(
+                optP->valid_set, Tcl_GetString(validObjs[i]), &newEntry);
+        }
+    }
+    else if (optP->type == OPT_INT) {
+        Tcl_WideInt *ints =
+            (Tcl_WideInt *)Tcl_Alloc(nvalid * sizeof(Tcl_WideInt));
+        Tcl_Size nunique;
+        for (i = 0; i < nvalid; ++i) {
+            if (Tcl_GetWideIntFromObj(NULL, validObjs[i], &ints[i]) != TCL_OK) {
+                /* Leave to the runtime check to report the error */
+                Tcl_Free((char *)ints);
+                return;
+            }
+        }
+        qsort(ints, nvalid, sizeof(ints[0]), CompareWideInts);
+        /* Drop duplicates so the count is valid for the range test below */
+        for (nunique = 1, i = 1; i < nvalid; ++i) {
+            if (ints[i] != ints[nunique - 1])
+                ints[nunique++] = ints[i];
+        }
+        optP->valid_ints = ints;
+        optP->nvalid_ints = nunique;
+        /* Unsigned arithmetic to avoid overflow on wide ranges */
+        optP->valid_is_range =
+            ((Tcl_WideUInt)ints[nunique - 1] - (Tcl_WideUInt)ints[0])
+            < (Tcl_WideUInt)nunique;
+    }
+}
+
+static void ParseargsSpecRelease(ParseargsSpec *specP)
+{
+    int i;
+
+    if (--specP->nRefs > 0)
+        return;
+
+    for (i = 0; i < specP->nmatches; ++i) {
+        if (specP->matches[i].radioChoice)
+            Tcl_DecrRefCount(specP->matches[i].radioChoice);
+    }
+    if (specP->matches)
+        Tcl_Free((char *)specP->matches);
+    Tcl_DeleteHashTable(&specP->lookup);
+    for (i = 0; i < specP->nopts; ++i) {
+        CleanupOptionDescriptor(&specP->opts[i]);
+    }
+    if (specP->opts)
+        Tcl_Free((char *)specP->opts);
+    Tcl_Free((char *)specP);
+}
+
+/*
+ * Adds a lookup entry for an option name or radio choice. If the name
+ * is already present, the earlier option takes precedence as it did when
+ * options were matched by a linear scan.
+ */
+static void ParseargsSpecAddMatch(ParseargsSpec *specP,
+                                  const char *name,
+                                  int optIndex,
+                                  Tcl_Obj *radioChoice)
+{
+    Tcl_HashEntry *he;
+    int newEntry;
+    struct OptionMatch *matchP;
+
+    he = Tcl_CreateHashEntry(&specP->lookup, name, &newEntry);
+    if (!newEntry)
+        return;
+    matchP = &specP->matches[specP->nmatches++];
+    matchP->optIndex = optIndex;
+    matchP->radioChoice = radioChoice;
+    if (radioChoice)
+        Tcl_IncrRefCount(radioChoice);
+    Tcl_SetHashValue(he, matchP);
+}
+
+/*
+ * Builds the lookup table for the option descriptors in a spec so that
+ * each argument is matched with a single hash lookup instead of a scan
+ * of all options and radio choices.
+ */
+static void ParseargsSpecBuildLookup(ParseargsSpec *specP)
+{
+    int j;
+    Tcl_Size nmatches;
+    Tcl_DString ds;
+
+    nmatches = 0;
+    for (j = 0; j < specP->nopts; ++j) {
+        Tcl_Size nchoices;
+        if (specP->opts[j].type != OPT_RADIO)
+            ++nmatches;
+        else if (specP->opts[j].valid_values
+                 && Tcl_ListObjLength(
+                        NULL, specP->opts[j].valid_values, &nchoices)
+                        == TCL_OK)
+            nmatches += nchoices;
+    }
+    specP->matches =
+        nmatches ? (struct OptionMatch *)Tcl_Alloc(nmatches * sizeof(*specP->matches))
+                 : NULL;
+
+    Tcl_DStringInit(&ds);
+    for (j = 0; j < specP->nopts; ++j) {
+        struct OptionDescriptor *optP = &specP->opts[j];
+        if (optP->type != OPT_RADIO) {
+            /* Key is the name without any .type suffix */
+            Tcl_DStringSetLength(&ds, 0);
+            Tcl_DStringAppend(&ds, Tcl_GetString(optP->name), optP->name_len);
+            ParseargsSpecAddMatch(specP, Tcl_DStringValue(&ds), j, NULL);
+        }
+        else {
+            Tcl_Size choice, nchoices;
+            Tcl_Obj **choices;
+            if (optP->valid_values
+                && Tcl_ListObjGetElements(
+                       NULL, optP->valid_values, &nchoices, &choices)
+                       == TCL_OK) {
+                for (choice = 0; choice < nchoices; ++choice) {
+                    ParseargsSpecAddMatch(specP,
+                                          Tcl_GetString(choices[choice]),
+                                          j,
+                                          choices[choice]);
+                }
+            }
+        }
+    }
+    Tcl_DStringFree(&ds);
+}
+
+#if TCLH_PARSEARGS_CACHE_MAX > 0
+/*
+ * Per-thread cache mapping option list strings to compiled specs. This is
+ * per-thread and not process-wide because the specs hold Tcl_Obj values
+ * which cannot be shared across threads.
+ */
+typedef struct ParseargsSpecCache {
+    int initialized;
+    Tcl_HashTable specs;  /* Option list string -> ParseargsSpec. Each
+                             entry holds a reference to the spec. */
+} ParseargsSpecCache;
+static Tcl_ThreadDataKey gParseargsSpecCacheKey;
+
+static void ParseargsSpecCacheClear(ParseargsSpecCache *cacheP)
+{
+    Tcl_HashEntry *he;
+    Tcl_HashSearch hSearch;
+
+    for (he = Tcl_FirstHashEntry(&cacheP->specs, &hSearch); he != NULL;
+         he = Tcl_NextHashEntry(&hSearch)) {
+        ParseargsSpecRelease((ParseargsSpec *)Tcl_GetHashValue(he));
+    }
+    Tcl_DeleteHashTable(&cacheP->specs);
+    Tcl_InitHashTable(&cacheP->specs, TCL_STRING_KEYS);
+}
+
+static void ParseargsSpecCacheFree(ClientData clientData)
+{
+    ParseargsSpecCache *cacheP = (ParseargsSpecCache *)clientData;
+    ParseargsSpecCacheClear(cacheP);
+    Tcl_DeleteHashTable(&cacheP->specs);
+    cacheP->initialized = 0;
+}
+
+static ParseargsSpecCache *ParseargsSpecCacheGet(void)
+{
+    /* Note Tcl_GetThreadData zeroes the block on first allocation */
+    ParseargsSpecCache *cacheP = (ParseargsSpecCache *)Tcl_GetThreadData(
+        &gParseargsSpecCacheKey, sizeof(ParseargsSpecCache));
+    if (!cacheP->initialized) {
+        cacheP->initialized = 1;
+        Tcl_InitHashTable(&cacheP->specs, TCL_STRING_KEYS);
+        Tcl_CreateThreadExitHandler(ParseargsSpecCacheFree, cacheP);
+    }
+    return cacheP;
 }
+#endif
 
 static void UpdateStringParseargsOpt(Tcl_Obj *objP)
 {
     /* Not the most efficient but not likely to be called often */
-    unsigned long i;
+    int i;
     Tcl_Obj *listObj = Tcl_NewListObj(0, NULL);
+    ParseargsSpec *specP = IntrepGetParseargsSpec(objP);
     struct OptionDescriptor *optP;
 
-    for (i = 0, optP = (struct OptionDescriptor *) objP->internalRep.ptrAndLongRep.ptr;
-         i < objP->internalRep.ptrAndLongRep.value;
-         ++i, ++optP) {
+    for (i = 0, optP = specP->opts; i < specP->nopts; ++i, ++optP) {
         Tcl_Obj *elems[3];
         Tcl_Size nelems;
         elems[0] = optP->name;
@@ -126,52 +718,23 @@ static void UpdateStringParseargsOpt(Tcl_Obj *objP)
 
 static void FreeParseargsOpt(Tcl_Obj *objP)
 {
-    unsigned long i;
-    struct OptionDescriptor *optsP;
-
-    if ((optsP = (struct OptionDescriptor *)objP->internalRep.ptrAndLongRep.ptr) != NULL) {
-        for (i = 0; i < objP->internalRep.ptrAndLongRep.value; ++i) {
-            CleanupOptionDescriptor(&optsP[i]);
-        }
-        Tcl_Free((char *) optsP);
-    }
+    ParseargsSpec *specP = IntrepGetParseargsSpec(objP);
 
-    objP->internalRep.ptrAndLongRep.ptr = NULL;
-    objP->internalRep.ptrAndLongRep.value = 0;
+    if (specP)
+        ParseargsSpecRelease(specP);
+    IntrepSetParseargsSpec(objP, NULL);
     objP->typePtr = NULL;
 }
 
 static void DupParseargsOpt(Tcl_Obj *srcP, Tcl_Obj *dstP)
 {
-    unsigned long i;
-    struct OptionDescriptor *doptsP;
-    struct OptionDescriptor *soptsP;
-    
-    dstP->typePtr = &gParseargsOptionType;
-    soptsP = srcP->internalRep.ptrAndLongRep.ptr;
-    if (soptsP == NULL) {
-        dstP->internalRep.ptrAndLongRep.ptr = NULL;
-        dstP->internalRep.ptrAndLongRep.value = 0;
-        return;
-    }
+    /* The compiled spec is immutable so just share it */
+    ParseargsSpec *specP = IntrepGetParseargsSpec(srcP);
 
-    doptsP = (struct OptionDescriptor *) Tcl_Alloc(srcP->internalRep.ptrAndLongRep.value * sizeof(*doptsP));
-    dstP->internalRep.ptrAndLongRep.ptr = doptsP;
-    i = srcP->internalRep.ptrAndLongRep.value;
-    dstP->internalRep.ptrAndLongRep.value = i;
-    while (i--) {
-        if ((doptsP->name = soptsP->name) != NULL)
-            Tcl_IncrRefCount(doptsP->name);
-        if ((doptsP->def_value = soptsP->def_value) != NULL)
-            Tcl_IncrRefCount(doptsP->def_value);
-        if ((doptsP->valid_values = soptsP->valid_values) != NULL)
-            Tcl_IncrRefCount(doptsP->valid_values);
-        doptsP->name_len = soptsP->name_len;
-        doptsP->type = soptsP->type;
-        doptsP->first = soptsP->first;
-        ++doptsP;
-        ++soptsP;
-    }
+    if (specP)
+        specP->nRefs++;
+    IntrepSetParseargsSpec(dstP, specP);
+    dstP->typePtr = &gParseargsOptionType;
 }
 
 static int SetParseargsOptFromAny(Tcl_Interp *interp, Tcl_Obj *objP)
@@ -180,18 +743,36 @@ static int SetParseargsOptFromAny(Tcl_Interp *interp, Tcl_Obj *objP)
     Tcl_Obj **optObjs;
     struct OptionDescriptor *optsP = NULL;
     struct OptionDescriptor *curP = NULL;
+    ParseargsSpec *specP;
     Tcl_Size len;
+#if TCLH_PARSEARGS_CACHE_MAX > 0
+    ParseargsSpecCache *cacheP;
+    Tcl_HashEntry *he;
+    int newEntry;
+#endif
 
     if (objP->typePtr == &gParseargsOptionType)
         return TCL_OK;          /* Already in correct format */
 
+#if TCLH_PARSEARGS_CACHE_MAX > 0
+    /* Check if this option list has been compiled before */
+    cacheP = ParseargsSpecCacheGet();
+    he = Tcl_FindHashEntry(&cacheP->specs, Tcl_GetString(objP));
+    if (he) {
+        specP = (ParseargsSpec *)Tcl_GetHashValue(he);
+        specP->nRefs++;
+        goto set_intrep;
+    }
+#endif
+
     if (Tcl_ListObjGetElements(interp, objP, &nopts, &optObjs) != TCL_OK)
         return TCL_ERROR;
     
-    if (nopts > ULONG_MAX) {
-        /* Will not fit in int rep ulong type */
-
-    } 
+    if (nopts > INT_MAX) {
+        /* Will not fit in ParseargsSpec.nopts */
+        Tcl_SetResult(interp, "Too many options in option list.", TCL_STATIC);
+        return TCL_ERROR;
+    }
     optsP = nopts ? (struct OptionDescriptor *) Tcl_Alloc(nopts * sizeof(*optsP)) : NULL;
 
     for (k = 0; k < nopts ; ++k) {
@@ -206,6 +787,10 @@ static int SetParseargsOptFromAny(Tcl_Interp *interp, Tcl_Obj *objP)
         curP->name = NULL;
         curP->def_value = NULL;
         curP->valid_values = NULL;
+        curP->valid_set = NULL;
+        curP->valid_ints = NULL;
+        curP->nvalid_ints = 0;
+        curP->valid_is_range = 0;
 
         if (Tcl_ListObjGetElements(interp, optObjs[k], &nelems, &elems) != TCL_OK ||
             nelems == 0) {
@@ -216,7 +801,6 @@ static int SetParseargsOptFromAny(Tcl_Interp *interp, Tcl_Obj *objP)
         curP->name = elems[0];
         Tcl_IncrRefCount(elems[0]);
         p = Tcl_GetStringFromObj(elems[0], &len);
-        curP->first = *p;
         type = Tcl_UtfFindFirst(p, '.');
         if (type == NULL)
             curP->name_len = (unsigned short) len;
@@ -267,18 +851,37 @@ static int SetParseargsOptFromAny(Tcl_Interp *interp, Tcl_Obj *objP)
                    value to use for 'true' */
                 curP->valid_values = elems[2];
                 Tcl_IncrRefCount(elems[2]);
+                CompileOptionValidValues(curP, nvalid, validObjs);
             }
         }
     }
     
-    /* OK, options are in order. Convert the passed object's internal rep */
+    /* OK, options are in order. Compile them into a spec */
+    specP = (ParseargsSpec *)Tcl_Alloc(sizeof(*specP));
+    specP->nRefs = 1;
+    specP->nopts = (int) nopts;
+    specP->opts = optsP;
+    specP->nmatches = 0;
+    Tcl_InitHashTable(&specP->lookup, TCL_STRING_KEYS);
+    ParseargsSpecBuildLookup(specP);
+
+#if TCLH_PARSEARGS_CACHE_MAX > 0
+    if (cacheP->specs.numEntries >= TCLH_PARSEARGS_CACHE_MAX)
+        ParseargsSpecCacheClear(cacheP);
+    he = Tcl_CreateHashEntry(&cacheP->specs, Tcl_GetString(objP), &newEntry);
+    TCLH_ASSERT(newEntry);
+    specP->nRefs++;
+    Tcl_SetHashValue(he, specP);
+
+set_intrep:
+#endif
+    /* Convert the passed object's internal rep */
     if (objP->typePtr && objP->typePtr->freeIntRepProc) {
         objP->typePtr->freeIntRepProc(objP);
         objP->typePtr = NULL;
     }
 
-    objP->internalRep.ptrAndLongRep.ptr = optsP;
-    objP->internalRep.ptrAndLongRep.value = (unsigned long) nopts;
+    IntrepSetParseargsSpec(objP, specP);
     objP->typePtr = &gParseargsOptionType;
 
     return TCL_OK;
@@ -357,12 +960,16 @@ Tclh_ReturnCode Tclh_ParseargsProc(
     int         nopts;
     int         j, k;
     Tcl_WideInt wide;
+    ParseargsSpec *specP;
     struct OptionDescriptor *opts;
     int         ignoreunknown = 0;
     int         nulldefault = 0;
     int         hyphenated = 0;
     int         setvars = 0;
+    int         dictmode = 0;
+    int         updateargv = 1;
     Tcl_Obj    *newargvObj = NULL;
+    Tcl_Obj    *leftoverObj;
     int         maxleftover = INT_MAX;
 #define PARSEARGS_STATIC 20
     Tcl_Obj    *values[PARSEARGS_STATIC];
@@ -371,23 +978,17 @@ Tclh_ReturnCode Tclh_ParseargsProc(
     Tcl_Obj    **retP = NULL;
     int         nret = 0;
     static const char *parseargs_options[] = {
-        "-hyphenated", "-ignoreunknown", "-maxleftover", "-nulldefault", "-setvars", NULL
+        "-dict", "-hyphenated", "-ignoreunknown", "-maxleftover",
+        "-nulldefault", "-setvars", "-updateargv", NULL
     };
     enum parseargs_options_e {
-        HYPHENATED, IGNOREUNKNOWN, MAXLEFTOVER, NULLDEFAULT, SETVARS
+        DICT, HYPHENATED, IGNOREUNKNOWN, MAXLEFTOVER, NULLDEFAULT, SETVARS,
+        UPDATEARGV
     };
-    Tcl_Obj *zeroObj = NULL;
-    Tcl_Obj *oneObj = NULL;
-    Tcl_Obj *emptyObj = NULL;
     int status;
 
-    /* Oof, ugly, yes. Unnecessary, indeed. Microoptimzation, that too */
-#define ZEROOBJ (zeroObj ? zeroObj : (zeroObj = Tcl_NewIntObj(0), Tcl_IncrRefCount(zeroObj), zeroObj))
-#define ONEOBJ (oneObj ? oneObj : (oneObj = Tcl_NewIntObj(1), Tcl_IncrRefCount(oneObj), oneObj))
-#define EMPTYOBJ (emptyObj ? emptyObj : (emptyObj = Tcl_NewObj(), Tcl_IncrRefCount(emptyObj), emptyObj))
-
     if (objc < 3) {
-        Tcl_WrongNumArgs(interp, 1, objv, "argvVar optlist ?-ignoreunknown? ?-nulldefault? ?-hyphenated? ?-maxleftover COUNT? ?--?");
+        Tcl_WrongNumArgs(interp, 1, objv, "argvVar optlist ?-ignoreunknown? ?-nulldefault? ?-hyphenated? ?-maxleftover COUNT? ?-dict? ?-updateargv? ?--?");
         return TCL_ERROR;
     }
 
@@ -397,8 +998,14 @@ Tclh_ReturnCode Tclh_ParseargsProc(
             return TCL_ERROR;
     }
 
-    opts =  objv[2]->internalRep.ptrAndLongRep.ptr;
-    nopts = objv[2]->internalRep.ptrAndLongRep.value;
+    /*
+     * Hold a reference to the compiled spec as objv[2] may shimmer, e.g.
+     * from variable traces, while we are using it.
+     */
+    specP = IntrepGetParseargsSpec(objv[2]);
+    specP->nRefs++;
+    opts =  specP->opts;
+    nopts = specP->nopts;
 
     if (nopts > PARSEARGS_STATIC) {
         valuesP = (Tcl_Obj **) Tcl_Alloc(nopts * sizeof(*valuesP));
@@ -420,6 +1027,8 @@ Tclh_ReturnCode Tclh_ParseargsProc(
             goto error_return;
 
         switch ((enum parseargs_options_e) parseargs_opt) {
+        case DICT:          dictmode = 1; break;
+        case UPDATEARGV:    updateargv = 2; break;
         case HYPHENATED:    hyphenated = 1; break;
         case IGNOREUNKNOWN: ignoreunknown = 1; break;
         case NULLDEFAULT:   nulldefault = 1; break;
@@ -438,6 +1047,13 @@ Tclh_ReturnCode Tclh_ParseargsProc(
         }
     }
 
+    if (dictmode && setvars) {
+        Tcl_SetResult(interp,
+                      "Options -dict and -setvars cannot be used together.",
+                      TCL_STATIC);
+        goto error_return;
+    }
+
     /* Collect the arguments into an array */
     argvObj = Tcl_ObjGetVar2(interp, objv[1], NULL, TCL_LEAVE_ERR_MSG);
     if (argvObj == NULL)
@@ -446,13 +1062,18 @@ Tclh_ReturnCode Tclh_ParseargsProc(
     if (Tcl_ListObjGetElements(interp, argvObj, &argc, &argv) != TCL_OK)
         goto error_return;
 
-    newargvObj = Tcl_NewListObj(0, NULL);
+    /*
+     * In -dict mode the argv variable is only written if -updateargv is
+     * also specified. Otherwise it is always written for compatibility.
+     */
+    if (dictmode && updateargv != 2)
+        updateargv = 0;
 
     /* OK, now go through the passed arguments */
     for (iarg = 0; iarg < argc; ++iarg) {
-        Tcl_Size   argp_len;
-        char *argp = Tcl_GetStringFromObj(argv[iarg], &argp_len);
+        char *argp = Tcl_GetString(argv[iarg]);
         Tcl_Obj *radioOpt;
+        Tcl_HashEntry *he;
 
         /* Non-option arg or a '-' or a "--" signals end of arguments */
         if (*argp != '-')
@@ -463,31 +1084,15 @@ Tclh_ReturnCode Tclh_ParseargsProc(
             break;
         }
 
-        /* Check against each option in turn */
-        radioOpt = NULL;
-        for (j = 0; j < nopts; ++j) {
-            if (opts[j].type != OPT_RADIO) {
-                if (opts[j].name_len == (argp_len-1) &&
-                    opts[j].first == argp[1] &&
-                    ! Tcl_UtfNcmp(Tcl_GetString(opts[j].name), argp+1, (argp_len-1))) {
-                    break;          /* Match ! */
-                }
-            } else {
-                /* OPT_RADIO - search radio choices */
-                Tcl_Size choice, nchoices;
-                Tcl_Obj **choices;
-                if (opts[j].valid_values && 
-                    Tcl_ListObjGetElements(NULL, opts[j].valid_values, &nchoices, &choices) == TCL_OK) {
-                    for (choice = 0; choice < nchoices; ++choice) {
-                        if (!strcmp(argp+1, Tcl_GetString(choices[choice]))) {
-                            radioOpt = choices[choice];
-                            break;
-                        }
-                    }
-                }
-                if (radioOpt)
-                    break;      /* Matched a radio option */
-            }
+        /* Look up the option names and radio choices */
+        he = Tcl_FindHashEntry(&specP->lookup, argp + 1);
+        if (he) {
+            struct OptionMatch *matchP = (struct OptionMatch *)Tcl_GetHashValue(he);
+            j = matchP->optIndex;
+            radioOpt = matchP->radioChoice;
+        } else {
+            j = nopts;
+            radioOpt = NULL;
         }
 
         if (j < nopts) {
@@ -495,7 +1100,7 @@ Tclh_ReturnCode Tclh_ParseargsProc(
              *  Matches option j. Remember the option value.
              */
             if (opts[j].type == OPT_SWITCH) {
-                valuesP[j] = ONEOBJ;
+                valuesP[j] = Tclh_ObjFromBool(1);
             } else if (opts[j].type == OPT_RADIO)
                 valuesP[j] = radioOpt;
             else {
@@ -520,6 +1125,8 @@ Tclh_ReturnCode Tclh_ParseargsProc(
              * argument. If it does not begin with a "-" assume it
              * is the value of the unknown option. Else it is the next option
              */
+            if (newargvObj == NULL)
+                newargvObj = Tcl_NewListObj(0, NULL);
             Tcl_ListObjAppendElement(interp, newargvObj, argv[iarg]);
             if (iarg < (argc-1)) {
                 argp = Tcl_GetString(argv[iarg+1]);
@@ -566,7 +1173,26 @@ Tclh_ReturnCode Tclh_ParseargsProc(
             }
 
             /* Check list of allowed values if specified */
-            if (opts[k].valid_values) {
+            if (opts[k].valid_ints) {
+                int valid;
+                if (opts[k].valid_is_range)
+                    valid = wide >= opts[k].valid_ints[0]
+                         && wide <= opts[k].valid_ints[opts[k].nvalid_ints - 1];
+                else
+                    valid = bsearch(&wide,
+                                    opts[k].valid_ints,
+                                    opts[k].nvalid_ints,
+                                    sizeof(opts[k].valid_ints[0]),
+                                    CompareWideInts) != NULL;
+                if (!valid) {
+                    ParseargsSetResultBadValue(interp, "Invalid",
+                                                    valuesP[k],
+                                                    opts[k].name,
+                                                    opts[k].name_len);
+                    goto error_return;
+                }
+            }
+            else if (opts[k].valid_values) {
                 Tcl_Obj **validObjs;
                 Tcl_Size nvalid, ivalid;
                 if (Tcl_ListObjGetElements(interp, opts[k].valid_values, &nvalid, &validObjs) != TCL_OK)
@@ -593,7 +1219,7 @@ Tclh_ReturnCode Tclh_ParseargsProc(
                 }
             }
             if (valuesP[k] == NULL) {
-                valuesP[k] = ZEROOBJ; /* Deals with -nulldefault case. */
+                valuesP[k] = Tclh_ObjSharedInt(0); /* Deals with -nulldefault case. */
             }
             break;
 
@@ -602,7 +1228,17 @@ Tclh_ReturnCode Tclh_ParseargsProc(
              * (else we would have continued above), return ""
              */
             /* Check list of allowed values if specified */
-            if (opts[k].valid_values) {
+            if (opts[k].valid_set) {
+                const char *s = valuesP[k] ? Tcl_GetString(valuesP[k]) : "";
+                if (Tcl_FindHashEntry(opts[k].valid_set, s) == NULL) {
+                    ParseargsSetResultBadValue(interp, "Invalid",
+                                                    valuesP[k],
+                                                    opts[k].name,
+                                                    opts[k].name_len);
+                    goto error_return;
+                }
+            }
+            else if (opts[k].valid_values) {
                 Tcl_Obj **validObjs;
                 Tcl_Size nvalid, ivalid;
                 char *s;
@@ -622,14 +1258,14 @@ Tclh_ReturnCode Tclh_ParseargsProc(
                 }
             }
             if (valuesP[k] == NULL)
-                valuesP[k] = EMPTYOBJ; /* Deals with -nulldefault */
+                valuesP[k] = Tclh_ObjEmpty(); /* Deals with -nulldefault */
 
             break;
 
         case OPT_SYM:
             /* Check list of allowed values if specified */
             if (valuesP[k] == NULL) {
-                valuesP[k] = ZEROOBJ; /* Deals with -nulldefault */
+                valuesP[k] = Tclh_ObjSharedInt(0); /* Deals with -nulldefault */
             } else {
                 Tcl_WideInt wide;
                 if (opts[k].valid_values) {
@@ -655,7 +1291,7 @@ Tclh_ReturnCode Tclh_ParseargsProc(
             /* Fallthru */
         case OPT_BOOL:
             if (valuesP[k] == NULL) {
-                valuesP[k] = ZEROOBJ;
+                valuesP[k] = Tclh_ObjFromBool(0);
             }
             else {
                 if (Tcl_GetBooleanFromObj(interp, valuesP[k], &j) == TCL_ERROR) {
@@ -674,11 +1310,7 @@ Tclh_ReturnCode Tclh_ParseargsProc(
                      * Need to allocate a new obj
                      * BAD  - Tcl_SetBooleanObj(opts[k].value, j); 
                      */
-                    if (j) {
-                        valuesP[k] = ONEOBJ;
-                    } else {
-                        valuesP[k] = ZEROOBJ;
-                    }
+                    valuesP[k] = Tclh_ObjFromBool(j);
                 }
             }
             break;
@@ -691,6 +1323,9 @@ Tclh_ReturnCode Tclh_ParseargsProc(
         if (hyphenated) {
             objP = Tcl_NewStringObj("-", 1);
             Tcl_AppendToObj(objP, Tcl_GetString(opts[k].name), opts[k].name_len);
+        } else if (opts[k].name->length == opts[k].name_len) {
+            /* No type suffix so share the option name itself */
+            objP = opts[k].name;
         } else {
             objP = Tcl_NewStringObj(Tcl_GetString(opts[k].name), opts[k].name_len);
         }
@@ -710,13 +1345,35 @@ Tclh_ReturnCode Tclh_ParseargsProc(
         goto error_return;
     }
 
-    /* Tack on the remaining items in the argument list to new argv */
-    while (iarg < argc) {
-        Tcl_ListObjAppendElement(interp, newargvObj, argv[iarg]);
-        ++iarg;
+    /*
+     * Tack on the remaining items in the argument list to new argv. In the
+     * common case of no ignored options, the new list is created from the
+     * remaining elements in a single allocation.
+     */
+    if (newargvObj == NULL) {
+        newargvObj = Tcl_NewListObj(argc - iarg, argv + iarg);
+    } else {
+        while (iarg < argc) {
+            Tcl_ListObjAppendElement(interp, newargvObj, argv[iarg]);
+            ++iarg;
+        }
     }
-
-    if (setvars) {
+    leftoverObj = newargvObj;
+
+    if (dictmode) {
+        /*
+         * Tcl has no interface to presize a dictionary so insert the
+         * pairs directly. Keys are unique since options are.
+         */
+        Tcl_Obj *resultObjs[2];
+        resultObjs[0] = Tcl_NewDictObj();
+        for (j = 0; j < nret; j += 2) {
+            Tcl_DictObjPut(NULL, resultObjs[0], retP[j], retP[j + 1]);
+        }
+        resultObjs[1] = newargvObj;
+        Tcl_SetObjResult(interp, Tcl_NewListObj(2, resultObjs));
+        newargvObj = NULL; /* Now owned by the result */
+    } else if (setvars) {
         for (j = 0; j < nret; j += 2) {
             if (Tcl_ObjSetVar2(interp, retP[j], NULL, retP[j+1], TCL_LEAVE_ERR_MSG) == NULL)
                 goto error_return;
@@ -729,8 +1386,10 @@ Tclh_ReturnCode Tclh_ParseargsProc(
        do not want those going away when the variable's value changes.
        So only update the variable after we create a list from retP above
     */
-    if (Tcl_ObjSetVar2(interp, objv[1], NULL, newargvObj, TCL_LEAVE_ERR_MSG)
-        == NULL) {
+    if (updateargv
+        && Tcl_ObjSetVar2(
+               interp, objv[1], NULL, leftoverObj, TCL_LEAVE_ERR_MSG)
+               == NULL) {
         goto error_return;
     }
     status = TCL_OK;
@@ -741,12 +1400,7 @@ vamoose: /* status should be TCL_OK or TCL_ERROR */
         Tcl_Free((char *) valuesP);
     if (retP && retP != retObjs)
         Tcl_Free((char *)retP);
-    if (zeroObj)
-        Tcl_DecrRefCount(zeroObj);
-    if (oneObj)
-        Tcl_DecrRefCount(oneObj);
-    if (emptyObj)
-        Tcl_DecrRefCount(emptyObj);
+    ParseargsSpecRelease(specP);
 
     return status;
 
@@ -768,3 +1422,287 @@ error_return:
     status = TCL_ERROR;
     goto vamoose;
 }
+
+static void ParseargsObjvBadValue(Tcl_Interp *interp,
+                                  const char *error_type,
+                                  Tcl_Obj *value,
+                                  const char *opt_name)
+{
+    if (interp) {
+        Tcl_SetObjResult(interp,
+                         Tcl_ObjPrintf("%s value '%s' specified for option '-%s'.",
+                                       error_type ? error_type : "Invalid",
+                                       Tcl_GetString(value),
+                                       opt_name));
+    }
+}
+
+static void ParseargsObjvUnknownOption(Tcl_Interp *interp,
+                                       const char *badopt,
+                                       const Tclh_ArgOption *optTable,
+                                       Tcl_Size nopts)
+{
+    Tcl_Obj *objP;
+    Tcl_Size j, k;
+    const char *sep = "-";
+
+    if (interp == NULL)
+        return;
+    objP = Tcl_ObjPrintf("Invalid option '%s'. Must be one of ", badopt);
+    for (j = 0; j < nopts; ++j) {
+        if (optTable[j].type != TCLH_ARGOPT_RADIO) {
+            Tcl_AppendPrintfToObj(objP, "%s%s", sep, optTable[j].name);
+            sep = ", -";
+        } else if (optTable[j].choices) {
+            for (k = 0; optTable[j].choices[k]; ++k) {
+                Tcl_AppendPrintfToObj(objP, "%s%s", sep, optTable[j].choices[k]);
+                sep = ", -";
+            }
+        }
+    }
+    Tcl_AppendToObj(objP, ".", 1);
+    Tcl_SetObjResult(interp, objP);
+}
+
+/*
+ * Parses a permitted value for a TCLH_ARGOPT_INT option. As in Tcl 9, the
+ * number is decimal unless it has an explicit 0x, 0b or 0o prefix so a
+ * leading 0 does not denote octal. Returns 1 on success, 0 on failure.
+ */
+static int
+ParseargsObjvChoiceToWide(const char *s, Tcl_WideInt *wideP)
+{
+    unsigned long long ull;
+    char *endP;
+    int negative = 0;
+    int base = 10;
+
+    if (*s == '-' || *s == '+')
+        negative = (*s++ == '-');
+    if (s[0] == '0') {
+        switch (s[1]) {
+        case 'x': case 'X': base = 16; s += 2; break;
+        case 'b': case 'B': base = 2; s += 2; break;
+        case 'o': case 'O': base = 8; s += 2; break;
+        default: break;
+        }
+    }
+    /* strtoull would accept leading space and a second sign */
+    if (!isalnum((unsigned char)*s))
+        return 0;
+    ull = strtoull(s, &endP, base);
+    if (*endP != '\0')
+        return 0;
+    /* Overflow returns ULLONG_MAX which is rejected below */
+    if (negative) {
+        if (ull > (unsigned long long)LLONG_MAX + 1)
+            return 0;
+        *wideP = ull == (unsigned long long)LLONG_MAX + 1
+                     ? LLONG_MIN
+                     : -(Tcl_WideInt)ull;
+    } else {
+        if (ull > LLONG_MAX)
+            return 0;
+        *wideP = (Tcl_WideInt)ull;
+    }
+    return 1;
+}
+
+/*
+ * Stores the value of an option into the options struct after checking
+ * it against the permitted values in the option table.
+ */
+static Tclh_ReturnCode
+ParseargsObjvStore(Tcl_Interp *interp,
+                   const Tclh_ArgOption *optP,
+                   Tcl_Obj *valueObj,
+                   void *structP)
+{
+    char *fieldP = (char *)structP + optP->offset;
+    const char *const *choices = optP->choices;
+    Tcl_WideInt wide;
+    int b;
+
+    switch (optP->type) {
+    case TCLH_ARGOPT_BOOL:
+        if (Tcl_GetBooleanFromObj(NULL, valueObj, &b) != TCL_OK) {
+            ParseargsObjvBadValue(interp, "Non-boolean", valueObj, optP->name);
+            return TCL_ERROR;
+        }
+        *(int *)fieldP = b;
+        return TCL_OK;
+
+    case TCLH_ARGOPT_INT:
+        if (Tclh_ObjToWideInt(NULL, valueObj, &wide) != TCL_OK) {
+            ParseargsObjvBadValue(interp, "Non-integer", valueObj, optP->name);
+            return TCL_ERROR;
+        }
+        if (choices) {
+            /*
+             * Permitted values are compared numerically as in the script
+             * level command. They are parsed directly from the static table
+             * to avoid creating a Tcl_Obj for each on every call.
+             */
+            for (; *choices; ++choices) {
+                Tcl_WideInt validWide;
+                if (ParseargsObjvChoiceToWide(*choices, &validWide)
+                    && validWide == wide)
+                    break;
+            }
+            if (*choices == NULL) {
+                ParseargsObjvBadValue(interp, "Invalid", valueObj, optP->name);
+                return TCL_ERROR;
+            }
+        }
+        *(Tcl_WideInt *)fieldP = wide;
+        return TCL_OK;
+
+    case TCLH_ARGOPT_ARG:
+        if (choices) {
+            const char *s = Tcl_GetString(valueObj);
+            for (; *choices; ++choices) {
+                if (!strcmp(*choices, s))
+                    break;
+            }
+            if (*choices == NULL) {
+                ParseargsObjvBadValue(interp, "Invalid", valueObj, optP->name);
+                return TCL_ERROR;
+            }
+        }
+        *(Tcl_Obj **)fieldP = valueObj;
+        return TCL_OK;
+
+    case TCLH_ARGOPT_SYM:
+        if (optP->symbols) {
+            const Tclh_ArgSymbol *symP;
+            const char *s = Tcl_GetString(valueObj);
+            for (symP = optP->symbols; symP->name; ++symP) {
+                if (!strcmp(symP->name, s)) {
+                    *(Tcl_WideInt *)fieldP = symP->value;
+                    return TCL_OK;
+                }
+            }
+        }
+        /* If passed value is numeric, we allow it */
+        if (Tclh_ObjToWideInt(NULL, valueObj, &wide) != TCL_OK) {
+            ParseargsObjvBadValue(interp, NULL, valueObj, optP->name);
+            return TCL_ERROR;
+        }
+        *(Tcl_WideInt *)fieldP = wide;
+        return TCL_OK;
+
+    case TCLH_ARGOPT_SWITCH:
+    case TCLH_ARGOPT_RADIO:
+        break;
+    }
+    TCLH_PANIC("Invalid option type %d.", optP->type);
+    return TCL_ERROR; /* NOTREACHED - keep compiler happy */
+}
+
+Tclh_ReturnCode
+Tclh_ParseargsObjv(Tcl_Interp *interp,
+                   const Tclh_ArgOption *optTable,
+                   Tcl_Size nopts,
+                   Tcl_Size objc,
+                   Tcl_Obj *const objv[],
+                   int flags,
+                   Tcl_Size maxLeftover,
+                   void *structP,
+                   Tcl_Size *firstArgP,
+                   Tcl_Obj **unknownObjs,
+                   Tcl_Size *nunknownP)
+{
+    Tcl_Size iarg;
+    Tcl_Size nunknown = 0;
+
+    for (iarg = 0; iarg < objc; ++iarg) {
+        const char *argp = Tcl_GetString(objv[iarg]);
+        const Tclh_ArgOption *optP = NULL;
+        int radioIndex = -1;
+        Tcl_Size j;
+
+        /* Non-option arg or a '-' or a "--" signals end of arguments */
+        if (*argp != '-')
+            break;
+        if ((argp[1] == 0) ||
+            (argp[1] == '-' && argp[2] == 0)) {
+            ++iarg;             /* Skip the - or -- */
+            break;
+        }
+
+        /*
+         * Option tables are small and static so a linear search is cheaper
+         * than building an index. As for the script level command, the
+         * first matching entry wins.
+         */
+        for (j = 0; j < nopts && optP == NULL; ++j) {
+            if (optTable[j].type == TCLH_ARGOPT_RADIO) {
+                int k;
+                if (optTable[j].choices == NULL)
+                    continue; /* Malformed entry, nothing to match */
+                for (k = 0; optTable[j].choices[k]; ++k) {
+                    if (!strcmp(optTable[j].choices[k], argp + 1)) {
+                        optP       = &optTable[j];
+                        radioIndex = k;
+                        break;
+                    }
+                }
+            } else if (!strcmp(optTable[j].name, argp + 1)) {
+                optP = &optTable[j];
+            }
+        }
+
+        if (optP == NULL) {
+            /* Does not match any option. */
+            if (!(flags & TCLH_PARSEARGS_IGNORE_UNKNOWN)) {
+                ParseargsObjvUnknownOption(interp, argp, optTable, nopts);
+                return TCL_ERROR;
+            }
+            /*
+             * Assume the next argument is the value of the unknown option
+             * unless it begins with a "-".
+             */
+            if (unknownObjs)
+                unknownObjs[nunknown++] = objv[iarg];
+            if (iarg < (objc - 1) && *Tcl_GetString(objv[iarg + 1]) != '-') {
+                ++iarg;
+                if (unknownObjs)
+                    unknownObjs[nunknown++] = objv[iarg];
+            }
+            continue;
+        }
+
+        if (optP->type == TCLH_ARGOPT_SWITCH) {
+            *(int *)((char *)structP + optP->offset) = 1;
+        } else if (optP->type == TCLH_ARGOPT_RADIO) {
+            *(int *)((char *)structP + optP->offset) = radioIndex;
+        } else {
+            if (iarg >= (objc - 1)) {
+                /* No more args! */
+                if (interp) {
+                    Tcl_AppendResult(
+                        interp, "No value supplied for option '", argp, "'", NULL);
+                }
+                return TCL_ERROR;
+            }
+            ++iarg;            /* Move on to next arg in array */
+            if (ParseargsObjvStore(interp, optP, objv[iarg], structP)
+                != TCL_OK)
+                return TCL_ERROR;
+        }
+    }
+
+    if (maxLeftover >= 0 && maxLeftover < (objc - iarg)) {
+        if (interp) {
+            Tcl_SetResult(
+                interp, "Command has extra arguments specified.", TCL_STATIC);
+        }
+        return TCL_ERROR;
+    }
+
+    if (firstArgP)
+        *firstArgP = iarg;
+    if (unknownObjs)
+        *nunknownP = nunknown;
+    return TCL_OK;
+}
@@ -0,0 +1,169 @@
+#ifndef TCLHDICTBUILDER_H
+#define TCLHDICTBUILDER_H
+
+/*
+ * Copyright (c) 2024, Ashok P. Nadkarni
+ * All rights reserved.
+ *
+ * See the file LICENSE for license
+ */
+
+#include <stddef.h>
+#include "tclhBase.h"
+#include "tclhObj.h"
+#include "tclhAtom.h"
+
+/* Section: Dictionary builder
+ *
+ * Builds Tcl dictionaries from C structs based on a static table
+ * describing the dictionary keys and the type and offset of the
+ * corresponding struct fields. The key Tcl_Obj values are obtained once
+ * from the atom registry when the builder is created so no key strings are
+ * allocated when building a dictionary. Small integer, boolean and empty
+ * values are returned from the shared caches in the Obj module.
+ *
+ * For example,
+ *
+ * (start code)
+ * typedef struct Info { int id; const char *name; double size; } Info;
+ * static const Tclh_DictBuilderField infoFields[] = {
+ *     TCLH_DICT_FIELD("id", TCLH_DICT_FIELD_INT, Info, id),
+ *     TCLH_DICT_FIELD("name", TCLH_DICT_FIELD_STRING, Info, name),
+ *     TCLH_DICT_FIELD("size", TCLH_DICT_FIELD_DOUBLE, Info, size),
+ * };
+ * ...
+ * Tclh_DictBuilderCreate(interp, NULL, infoFields, 3, &builderP);
+ * ...
+ * Tcl_SetObjResult(interp, Tclh_DictBuilderBuild(builderP, &info));
+ * (end code)
+ *
+ * The Atom module must be initialized with <Tclh_AtomLibInit> before
+ * creating a builder.
+ */
+
+/* Typedef: Tclh_DictFieldType
+ * Type of a struct field converted by a dictionary builder.
+ */
+typedef enum Tclh_DictFieldType {
+    TCLH_DICT_FIELD_SCHAR,     /* signed char */
+    TCLH_DICT_FIELD_UCHAR,     /* unsigned char */
+    TCLH_DICT_FIELD_SHORT,     /* short */
+    TCLH_DICT_FIELD_USHORT,    /* unsigned short */
+    TCLH_DICT_FIELD_INT,       /* int */
+    TCLH_DICT_FIELD_UINT,      /* unsigned int */
+    TCLH_DICT_FIELD_LONG,      /* long */
+    TCLH_DICT_FIELD_ULONG,     /* unsigned long */
+    TCLH_DICT_FIELD_LONGLONG,  /* long long */
+    TCLH_DICT_FIELD_ULONGLONG, /* unsigned long long */
+    TCLH_DICT_FIELD_FLOAT,     /* float */
+    TCLH_DICT_FIELD_DOUBLE,    /* double */
+    TCLH_DICT_FIELD_BOOL,      /* int treated as a boolean */
+    TCLH_DICT_FIELD_STRING,    /* const char *, NULL is an empty string */
+    TCLH_DICT_FIELD_OBJ        /* Tcl_Obj *, NULL is an empty string */
+} Tclh_DictFieldType;
+
+/* Typedef: Tclh_DictBuilderField
+ * Describes a dictionary key and the struct field holding its value.
+ */
+typedef struct Tclh_DictBuilderField {
+    const char *key;         /* Dictionary key */
+    Tclh_DictFieldType type; /* Type of the struct field */
+    size_t offset;           /* Offset of the field within the struct */
+} Tclh_DictBuilderField;
+
+/* Macro: TCLH_DICT_FIELD
+ * Initializer for a <Tclh_DictBuilderField> table entry.
+ *
+ * Parameters:
+ * key_ - dictionary key string
+ * type_ - <Tclh_DictFieldType> of the field
+ * struct_ - the struct type
+ * member_ - the struct member holding the value
+ */
+#define TCLH_DICT_FIELD(key_, type_, struct_, member_)                         \
+    { key_, type_, offsetof(struct_, member_) }
+
+/* Typedef: Tclh_DictBuilder
+ * Opaque type holding a dictionary builder.
+ */
+typedef struct Tclh_DictBuilder Tclh_DictBuilder;
+
+/* Function: Tclh_DictBuilderCreate
+ * Creates a dictionary builder from a field table.
+ *
+ * Parameters:
+ * interp - Interpreter for error messages. May be NULL.
+ * tclhCtxP - Tclh context as returned by <Tclh_LibInit> to use. If NULL,
+ *    the Tclh context associated with the interpreter is used.
+ * fieldsP - array of field descriptors. This is referenced, not copied,
+ *    and must remain valid for the lifetime of the builder. Normally this
+ *    is a static table.
+ * nfields - number of elements in *fieldsP*
+ * builderPP - location to store the builder. This must be freed with
+ *    <Tclh_DictBuilderFree>.
+ *
+ * At least one of interp and tclhCtxP must be non-NULL. As it holds
+ * references to Tcl_Obj keys, the builder may only be used in the thread
+ * that created it.
+ *
+ * Returns:
+ * TCL_OK on success, TCL_ERROR with an error message in the interpreter.
+ */
+TCLH_LOCAL Tclh_ReturnCode
+Tclh_DictBuilderCreate(Tcl_Interp *interp,
+                       Tclh_LibContext *tclhCtxP,
+                       const Tclh_DictBuilderField *fieldsP,
+                       Tcl_Size nfields,
+                       Tclh_DictBuilder **builderPP);
+
+/* Function: Tclh_DictBuilderFree
+ * Frees a dictionary builder.
+ *
+ * Parameters:
+ * builderP - builder returned by <Tclh_DictBuilderCreate>. May be NULL.
+ */
+TCLH_LOCAL void Tclh_DictBuilderFree(Tclh_DictBuilder *builderP);
+
+/* Function: Tclh_DictBuilderBuild
+ * Returns a dictionary built from the fields of a C struct.
+ *
+ * Parameters:
+ * builderP - builder returned by <Tclh_DictBuilderCreate>
+ * structP - pointer to the struct
+ *
+ * Returns:
+ * A Tcl dictionary with a zero reference count.
+ */
+TCLH_LOCAL Tcl_Obj *Tclh_DictBuilderBuild(const Tclh_DictBuilder *builderP,
+                                          const void *structP);
+
+/* Function: Tclh_DictBuilderBuildObjv
+ * Returns a dictionary from an array of values in field table order.
+ *
+ * Parameters:
+ * builderP - builder returned by <Tclh_DictBuilderCreate>
+ * objv - array of values, one per field in the builder's table. The field
+ *    types in the table are ignored. A NULL element is stored as an empty
+ *    string.
+ *
+ * This is useful when values are not held in a struct but the keys are
+ * still to be shared.
+ *
+ * Returns:
+ * A Tcl dictionary with a zero reference count.
+ */
+TCLH_LOCAL Tcl_Obj *Tclh_DictBuilderBuildObjv(const Tclh_DictBuilder *builderP,
+                                              Tcl_Obj *const objv[]);
+
+#ifdef TCLH_SHORTNAMES
+#define DictBuilderCreate    Tclh_DictBuilderCreate
+#define DictBuilderFree      Tclh_DictBuilderFree
+#define DictBuilderBuild     Tclh_DictBuilderBuild
+#define DictBuilderBuildObjv Tclh_DictBuilderBuildObjv
+#endif
+
+#ifdef TCLH_IMPL
+#include "tclhDictBuilderImpl.c"
+#endif
+
+#endif /* TCLHDICTBUILDER_H */
@@ -0,0 +1,150 @@
+/*
+ * Copyright (c) 2024, Ashok P. Nadkarni
+ * All rights reserved.
+ *
+ * See the file LICENSE for license
+ */
+
+#include "tclhDictBuilder.h"
+
+struct Tclh_DictBuilder {
+    const Tclh_DictBuilderField *fieldsP; /* Field table, not owned */
+    Tcl_Size nfields;                     /* Number of fields */
+    Tcl_Obj *keyObjs[1];                  /* Actual size nfields. Each holds
+                                             a reference. */
+};
+
+Tclh_ReturnCode
+Tclh_DictBuilderCreate(Tcl_Interp *interp,
+                       Tclh_LibContext *tclhCtxP,
+                       const Tclh_DictBuilderField *fieldsP,
+                       Tcl_Size nfields,
+                       Tclh_DictBuilder **builderPP)
+{
+    Tclh_DictBuilder *builderP;
+    Tcl_Size i;
+
+    if (nfields < 0) {
+        return Tclh_ErrorInvalidValueStr(
+            interp, NULL, "Negative field count passed to dictionary builder.");
+    }
+    if (tclhCtxP == NULL) {
+        if (interp == NULL || Tclh_LibInit(interp, &tclhCtxP) != TCL_OK)
+            return TCL_ERROR;
+    }
+
+    builderP = (Tclh_DictBuilder *)Tcl_Alloc(
+        sizeof(*builderP)
+        + (nfields ? nfields - 1 : 0) * sizeof(builderP->keyObjs[0]));
+    builderP->fieldsP = fieldsP;
+    builderP->nfields = 0;
+    for (i = 0; i < nfields; ++i) {
+        Tcl_Obj *keyObj = Tclh_AtomGet(interp, tclhCtxP, fieldsP[i].key);
+        if (keyObj == NULL) {
+            Tclh_DictBuilderFree(builderP);
+            return TCL_ERROR;
+        }
+        /* Our own reference in case the registry is purged */
+        Tcl_IncrRefCount(keyObj);
+        builderP->keyObjs[i] = keyObj;
+        builderP->nfields    = i + 1;
+    }
+    *builderPP = builderP;
+    return TCL_OK;
+}
+
+void
+Tclh_DictBuilderFree(Tclh_DictBuilder *builderP)
+{
+    Tcl_Size i;
+    if (builderP == NULL)
+        return;
+    for (i = 0; i < builderP->nfields; ++i) {
+        Tcl_DecrRefCount(builderP->keyObjs[i]);
+    }
+    Tcl_Free((char *)builderP);
+}
+
+static Tcl_Obj *
+TclhDictBuilderFieldValue(const Tclh_DictBuilderField *fieldP,
+                          const void *structP)
+{
+    const char *p = (const char *)structP + fieldP->offset;
+
+    switch (fieldP->type) {
+    case TCLH_DICT_FIELD_SCHAR:
+        return Tclh_ObjSharedInt(*(const signed char *)p);
+    case TCLH_DICT_FIELD_UCHAR:
+        return Tclh_ObjSharedInt(*(const unsigned char *)p);
+    case TCLH_DICT_FIELD_SHORT:
+        return Tclh_ObjSharedInt(*(const short *)p);
+    case TCLH_DICT_FIELD_USHORT:
+        return Tclh_ObjSharedInt(*(const unsigned short *)p);
+    case TCLH_DICT_FIELD_INT:
+        return Tclh_ObjSharedInt(*(const int *)p);
+    case TCLH_DICT_FIELD_UINT:
+        return Tclh_ObjSharedInt(*(const unsigned int *)p);
+    case TCLH_DICT_FIELD_LONG:
+        return Tclh_ObjSharedInt(*(const long *)p);
+    case TCLH_DICT_FIELD_ULONG:
+        return Tclh_ObjSharedULongLong(*(const unsigned long *)p);
+    case TCLH_DICT_FIELD_LONGLONG:
+        return Tclh_ObjSharedInt(*(const long long *)p);
+    case TCLH_DICT_FIELD_ULONGLONG:
+        return Tclh_ObjSharedULongLong(*(const unsigned long long *)p);
+    case TCLH_DICT_FIELD_FLOAT:
+        return Tcl_NewDoubleObj(*(const float *)p);
+    case TCLH_DICT_FIELD_DOUBLE:
+        return Tcl_NewDoubleObj(*(const double *)p);
+    case TCLH_DICT_FIELD_BOOL:
+        return Tclh_ObjFromBool(*(const int *)p);
+    case TCLH_DICT_FIELD_STRING:
+        {
+            const char *s = *(const char *const *)p;
+            return s && *s ? Tcl_NewStringObj(s, -1) : Tclh_ObjEmpty();
+        }
+    case TCLH_DICT_FIELD_OBJ:
+        {
+            Tcl_Obj *objP = *(Tcl_Obj *const *)p;
+            return objP ? objP : Tclh_ObjEmpty();
+        }
+    }
+    TCLH_PANIC("Invalid dictionary builder field type %d.", fieldP->type);
+    return NULL; /* NOTREACHED - keep compiler happy */
+}
+
+Tcl_Obj *
+Tclh_DictBuilderBuild(const Tclh_DictBuilder *builderP, const void *structP)
+{
+    Tcl_Obj *dictObj = Tcl_NewDictObj();
+    Tcl_Size i;
+
+    /*
+     * Tcl has no API to presize a dictionary. The table is small and the
+     * keys already have their string representations so this is a single
+     * pass of hash insertions with no allocation for keys.
+     */
+    for (i = 0; i < builderP->nfields; ++i) {
+        Tcl_DictObjPut(NULL,
+                       dictObj,
+                       builderP->keyObjs[i],
+                       TclhDictBuilderFieldValue(&builderP->fieldsP[i], structP));
+    }
+    return dictObj;
+}
+
+Tcl_Obj *
+Tclh_DictBuilderBuildObjv(const Tclh_DictBuilder *builderP,
+                          Tcl_Obj *const objv[])
+{
+    Tcl_Obj *dictObj = Tcl_NewDictObj();
+    Tcl_Size i;
+
+    for (i = 0; i < builderP->nfields; ++i) {
+        Tcl_DictObjPut(NULL,
+                       dictObj,
+                       builderP->keyObjs[i],
+                       objv[i] ? objv[i] : Tclh_ObjEmpty());
+    }
+    return dictObj;
+}
@@ -0,0 +1,286 @@
+#ifndef TCLHMARSHAL_H
+#define TCLHMARSHAL_H
+
+/*
+ * Copyright (c) 2024, Ashok P. Nadkarni
+ * All rights reserved.
+ *
+ * See the file LICENSE for license
+ */
+
+#include "tclhBase.h"
+#include "tclhObj.h"
+#include "tclhAtom.h"
+
+/* Section: Argument marshalling
+ *
+ * Converts an array of Tcl_Obj values to a packed block of native values
+ * and back based on a signature string compiled once with
+ * <Tclh_MarshalSigCompile>. The type dispatch for each argument is
+ * resolved at compile time so marshalling an objv[] array is a single
+ * loop over precomputed converters.
+ *
+ * A signature is a sequence of type codes, one per argument.
+ *
+ *   c - signed char
+ *   C - unsigned char
+ *   h - short
+ *   H - unsigned short
+ *   i - int
+ *   u - unsigned int
+ *   l - long
+ *   L - unsigned long
+ *   w - long long
+ *   W - unsigned long long
+ *   f - float
+ *   d - double
+ *   s - const char *, pointing to the string representation of the
+ *       Tcl_Obj. Only valid as long as the Tcl_Obj is not modified.
+ *   o - Tcl_Obj *, no reference count is taken.
+ *   p - void *. May be followed by ^TAG to require a pointer of type TAG
+ *       where TAG extends to the next ; or end of the signature. The
+ *       Pointer module (tclhPointer.h) must be included before this
+ *       header for pointer support.
+ *
+ * For example, "ihuLdp^HANDLE" describes six arguments with the last
+ * being a pointer tagged as HANDLE.
+ *
+ * The native values are laid out in the block in signature order with
+ * the same alignment and padding a C compiler would use for a struct
+ * with the same member types in the same order. The block may therefore
+ * be accessed through a pointer to such a struct.
+ */
+
+/* Typedef: Tclh_MarshalSig
+ * Opaque type holding a compiled signature.
+ */
+typedef struct Tclh_MarshalSig Tclh_MarshalSig;
+
+/* Function: Tclh_MarshalSigCompile
+ * Compiles a signature string for use with the marshalling functions.
+ *
+ * Parameters:
+ * interp - Interpreter for error messages. May be NULL.
+ * tclhCtxP - Tclh context as returned by <Tclh_LibInit> to use for
+ *    pointer verification. If NULL, the Tclh context associated with
+ *    the interpreter is used.
+ * sig - the signature string
+ * sigPP - location to store the compiled signature. This must be freed
+ *    with <Tclh_MarshalSigFree>.
+ *
+ * Returns:
+ * TCL_OK on success, TCL_ERROR with an error message in the interpreter
+ * if the signature is invalid.
+ */
+TCLH_LOCAL Tclh_ReturnCode Tclh_MarshalSigCompile(Tcl_Interp *interp,
+                                                  Tclh_LibContext *tclhCtxP,
+                                                  const char *sig,
+                                                  Tclh_MarshalSig **sigPP);
+
+/* Function: Tclh_MarshalSigFree
+ * Frees a compiled signature.
+ *
+ * Parameters:
+ * sigP - signature returned by <Tclh_MarshalSigCompile>. May be NULL.
+ */
+TCLH_LOCAL void Tclh_MarshalSigFree(Tclh_MarshalSig *sigP);
+
+/* Function: Tclh_MarshalSigNumArgs
+ * Returns the number of arguments described by a compiled signature.
+ *
+ * Parameters:
+ * sigP - signature returned by <Tclh_MarshalSigCompile>.
+ */
+TCLH_LOCAL Tcl_Size Tclh_MarshalSigNumArgs(const Tclh_MarshalSig *sigP);
+
+/* Function: Tclh_MarshalSigBlockSize
+ * Returns the size of the native argument block for a compiled signature.
+ *
+ * Parameters:
+ * sigP - signature returned by <Tclh_MarshalSigCompile>.
+ *
+ * The returned size includes trailing padding so blocks may be placed
+ * in an array.
+ */
+TCLH_LOCAL size_t Tclh_MarshalSigBlockSize(const Tclh_MarshalSig *sigP);
+
+/* Function: Tclh_MarshalSigArgOffset
+ * Returns the offset of an argument within the native argument block.
+ *
+ * Parameters:
+ * sigP - signature returned by <Tclh_MarshalSigCompile>.
+ * argIndex - index of the argument. Must be less than the value returned
+ *    by <Tclh_MarshalSigNumArgs>.
+ */
+TCLH_LOCAL size_t Tclh_MarshalSigArgOffset(const Tclh_MarshalSig *sigP,
+                                           Tcl_Size argIndex);
+
+/* Function: Tclh_MarshalObjv
+ * Converts an array of Tcl_Obj values into a native argument block.
+ *
+ * Parameters:
+ * interp - Interpreter for error messages. May be NULL.
+ * sigP - signature returned by <Tclh_MarshalSigCompile>.
+ * objc - number of elements in *objv*. Must be the same as the number
+ *    of arguments in the signature.
+ * objv - the Tcl_Obj values to convert
+ * blockP - the native argument block. Must be at least
+ *    <Tclh_MarshalSigBlockSize> bytes and suitably aligned for the
+ *    largest type in the signature.
+ *
+ * On error, the contents of *blockP* are undefined.
+ *
+ * Returns:
+ * TCL_OK on success, TCL_ERROR with an error message in the interpreter.
+ */
+TCLH_LOCAL Tclh_ReturnCode Tclh_MarshalObjv(Tcl_Interp *interp,
+                                            const Tclh_MarshalSig *sigP,
+                                            Tcl_Size objc,
+                                            Tcl_Obj *const objv[],
+                                            void *blockP);
+
+/* Function: Tclh_MarshalToObjv
+ * Converts a native argument block into an array of Tcl_Obj values.
+ *
+ * Parameters:
+ * sigP - signature returned by <Tclh_MarshalSigCompile>.
+ * blockP - the native argument block.
+ * objv - array of size <Tclh_MarshalSigNumArgs> to hold the Tcl_Obj
+ *    values. Small integers may be shared as for <Tclh_ObjSharedInt> so the
+ *    reference counts of the returned values are not necessarily zero.
+ *
+ * A NULL *s* or *o* value is returned as an empty string.
+ */
+TCLH_LOCAL void Tclh_MarshalToObjv(const Tclh_MarshalSig *sigP,
+                                   const void *blockP,
+                                   Tcl_Obj *objv[]);
+
+/* Function: Tclh_MarshalToList
+ * Converts a native argument block into a Tcl list.
+ *
+ * Parameters:
+ * sigP - signature returned by <Tclh_MarshalSigCompile>.
+ * blockP - the native argument block.
+ *
+ * Returns:
+ * A Tcl list with a zero reference count.
+ */
+TCLH_LOCAL Tcl_Obj *Tclh_MarshalToList(const Tclh_MarshalSig *sigP,
+                                       const void *blockP);
+
+/* Section: Struct marshalling
+ *
+ * Converts between Tcl dictionaries and C structs based on a struct
+ * layout definition. The definition is a Tcl list of alternating field
+ * names and field types. A field type is one of
+ *
+ *   CODE - any single type code described in <Argument marshalling>
+ *          including pointer tags, e.g. *i* or *p^HANDLE*
+ *   {struct DEFINITION} - a nested struct with the given layout definition
+ *   {array COUNT TYPE} - a fixed size array of COUNT elements of TYPE
+ *          where TYPE is a type code or nested struct. The corresponding
+ *          Tcl value is a list.
+ *
+ * Fields are laid out with the same alignment and padding as a C compiler
+ * would use for the equivalent struct. For example, the definition
+ *
+ * (start code)
+ * x i y i tag {array 8 C} inner {struct {a d b p^HANDLE}}
+ * (end code)
+ *
+ * corresponds to
+ *
+ * (start code)
+ * struct {
+ *     int x, y;
+ *     unsigned char tag[8];
+ *     struct { double a; void *b; } inner;
+ * };
+ * (end code)
+ *
+ * The compiled layout is cached in the internal representation of the Tcl_Obj
+ * holding the definition so callers should keep and reuse the same Tcl_Obj
+ * for repeated conversions.
+ */
+
+/* Function: Tclh_MarshalStructSize
+ * Returns the size of a C struct described by a layout definition.
+ *
+ * Parameters:
+ * interp - Interpreter for error messages. May be NULL.
+ * layoutObj - the struct layout definition
+ * sizeP - location to store the size of the struct
+ * alignP - location to store the alignment of the struct. May be NULL.
+ *
+ * Returns:
+ * TCL_OK on success, TCL_ERROR with an error message in the interpreter
+ * if the layout definition is invalid.
+ */
+TCLH_LOCAL Tclh_ReturnCode Tclh_MarshalStructSize(Tcl_Interp *interp,
+                                                  Tcl_Obj *layoutObj,
+                                                  size_t *sizeP,
+                                                  size_t *alignP);
+
+/* Function: Tclh_MarshalDictToStruct
+ * Converts a Tcl dictionary to a C struct.
+ *
+ * Parameters:
+ * interp - Interpreter for error messages. May be NULL.
+ * tclhCtxP - Tclh context as returned by <Tclh_LibInit> to use for
+ *    pointer verification. If NULL, the Tclh context associated with
+ *    the interpreter is used.
+ * layoutObj - the struct layout definition
+ * dictObj - dictionary containing the field values. All fields in the
+ *    layout must be present. Additional keys are ignored.
+ * structP - location to store the struct. Must be at least the size
+ *    returned by <Tclh_MarshalStructSize> and suitably aligned.
+ *
+ * On error, the contents of *structP* are undefined.
+ *
+ * Returns:
+ * TCL_OK on success, TCL_ERROR with an error message in the interpreter.
+ */
+TCLH_LOCAL Tclh_ReturnCode Tclh_MarshalDictToStruct(Tcl_Interp *interp,
+                                                    Tclh_LibContext *tclhCtxP,
+                                                    Tcl_Obj *layoutObj,
+                                                    Tcl_Obj *dictObj,
+                                                    void *structP);
+
+/* Function: Tclh_MarshalStructToDict
+ * Converts a C struct to a Tcl dictionary.
+ *
+ * Parameters:
+ * interp - Interpreter for error messages. May be NULL.
+ * layoutObj - the struct layout definition
+ * structP - pointer to the struct
+ * dictObjP - location to store the dictionary. This will have a zero
+ *    reference count.
+ *
+ * Returns:
+ * TCL_OK on success, TCL_ERROR with an error message in the interpreter
+ * if the layout definition is invalid.
+ */
+TCLH_LOCAL Tclh_ReturnCode Tclh_MarshalStructToDict(Tcl_Interp *interp,
+                                                    Tcl_Obj *layoutObj,
+                                                    const void *structP,
+                                                    Tcl_Obj **dictObjP);
+
+#ifdef TCLH_SHORTNAMES
+#define MarshalStructSize   Tclh_MarshalStructSize
+#define MarshalDictToStruct Tclh_MarshalDictToStruct
+#define MarshalStructToDict Tclh_MarshalStructToDict
+#define MarshalSigCompile   Tclh_MarshalSigCompile
+#define MarshalSigFree      Tclh_MarshalSigFree
+#define MarshalSigNumArgs   Tclh_MarshalSigNumArgs
+#define MarshalSigBlockSize Tclh_MarshalSigBlockSize
+#define MarshalSigArgOffset Tclh_MarshalSigArgOffset
+#define MarshalObjv         Tclh_MarshalObjv
+#define MarshalToObjv       Tclh_MarshalToObjv
+#define MarshalToList       Tclh_MarshalToList
+#endif
+
+#ifdef TCLH_IMPL
+#include "tclhMarshalImpl.c"
+#endif
+
+#endif /* TCLHMARSHAL_H */
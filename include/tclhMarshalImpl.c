@@ -0,0 +1,781 @@
+/*
+ * Copyright (c) 2024, Ashok P. Nadkarni
+ * All rights reserved.
+ *
+ * See the file LICENSE for license
+ */
+
+#include "tclhMarshal.h"
+#include <stddef.h>
+
+typedef struct TclhMarshalArg TclhMarshalArg;
+typedef Tclh_ReturnCode TclhMarshalToNativeProc(Tcl_Interp *interp,
+                                                Tclh_LibContext *tclhCtxP,
+                                                const TclhMarshalArg *argP,
+                                                Tcl_Obj *objP,
+                                                void *valueP);
+typedef Tcl_Obj *TclhMarshalFromNativeProc(const TclhMarshalArg *argP,
+                                           const void *valueP);
+
+/* Compiled descriptor for a single argument */
+struct TclhMarshalArg {
+    TclhMarshalToNativeProc *toNativeProc;
+    TclhMarshalFromNativeProc *fromNativeProc;
+    size_t offset;   /* Offset of value within native block */
+    Tcl_Obj *tagObj; /* Pointer tag. NULL if not a pointer or untagged */
+};
+
+struct Tclh_MarshalSig {
+    Tclh_LibContext *tclhCtxP; /* For pointer verification. May be NULL */
+    Tcl_Size nargs;            /* Number of elements in args[] */
+    size_t blockSize;          /* Size of native block including padding */
+    TclhMarshalArg args[1];    /* Actually nargs elements */
+};
+
+/* Alignment of a type within a struct. Portable to pre-C11 compilers. */
+#define TCLH_MARSHAL_ALIGNOF(type_) \
+    offsetof(struct { char c_; type_ v_; }, v_)
+
+/*
+ * Converters for each type code. These are looked up once at compile time
+ * and then called through the function pointers in TclhMarshalArg.
+ */
+#define TCLH_MARSHAL_CONVERTERS(name_, ctype_, toFn_, fromFn_)                \
+    static Tclh_ReturnCode TclhMarshalTo##name_(Tcl_Interp *interp,          \
+                                                Tclh_LibContext *tclhCtxP,    \
+                                                const TclhMarshalArg *argP,   \
+                                                Tcl_Obj *objP,                \
+                                                void *valueP)                 \
+    {                                                                         \
+        (void)tclhCtxP;                                                       \
+        (void)argP;                                                           \
+        return toFn_(interp, objP, (ctype_ *)valueP);                         \
+    }                                                                         \
+    static Tcl_Obj *TclhMarshalFrom##name_(const TclhMarshalArg *argP,        \
+                                           const void *valueP)                \
+    {                                                                         \
+        (void)argP;                                                           \
+        return fromFn_(*(const ctype_ *)valueP);                              \
+    }
+
+TCLH_MARSHAL_CONVERTERS(SChar, signed char, Tclh_ObjToChar, Tclh_ObjSharedInt)
+TCLH_MARSHAL_CONVERTERS(UChar, unsigned char, Tclh_ObjToUChar, Tclh_ObjSharedInt)
+TCLH_MARSHAL_CONVERTERS(Short, short, Tclh_ObjToShort, Tclh_ObjSharedInt)
+TCLH_MARSHAL_CONVERTERS(UShort, unsigned short, Tclh_ObjToUShort, Tclh_ObjSharedInt)
+TCLH_MARSHAL_CONVERTERS(Int, int, Tclh_ObjToInt, Tclh_ObjSharedInt)
+TCLH_MARSHAL_CONVERTERS(UInt, unsigned int, Tclh_ObjToUInt, Tclh_ObjSharedInt)
+TCLH_MARSHAL_CONVERTERS(Long, long, Tclh_ObjToLong, Tclh_ObjSharedInt)
+TCLH_MARSHAL_CONVERTERS(ULong, unsigned long, Tclh_ObjToULong, Tclh_ObjSharedULongLong)
+TCLH_MARSHAL_CONVERTERS(LongLong, signed long long, Tclh_ObjToLongLong, Tclh_ObjSharedInt)
+TCLH_MARSHAL_CONVERTERS(ULongLong, unsigned long long, Tclh_ObjToULongLong, Tclh_ObjSharedULongLong)
+TCLH_MARSHAL_CONVERTERS(Float, float, Tclh_ObjToFloat, Tcl_NewDoubleObj)
+TCLH_MARSHAL_CONVERTERS(Double, double, Tclh_ObjToDouble, Tcl_NewDoubleObj)
+
+#undef TCLH_MARSHAL_CONVERTERS
+
+static Tclh_ReturnCode
+TclhMarshalToString(Tcl_Interp *interp,
+                    Tclh_LibContext *tclhCtxP,
+                    const TclhMarshalArg *argP,
+                    Tcl_Obj *objP,
+                    void *valueP)
+{
+    (void)interp;
+    (void)tclhCtxP;
+    (void)argP;
+    *(const char **)valueP = Tcl_GetString(objP);
+    return TCL_OK;
+}
+
+static Tcl_Obj *
+TclhMarshalFromString(const TclhMarshalArg *argP, const void *valueP)
+{
+    const char *s = *(const char *const *)valueP;
+    (void)argP;
+    return s ? Tcl_NewStringObj(s, -1) : Tclh_ObjEmpty();
+}
+
+static Tclh_ReturnCode
+TclhMarshalToObj(Tcl_Interp *interp,
+                 Tclh_LibContext *tclhCtxP,
+                 const TclhMarshalArg *argP,
+                 Tcl_Obj *objP,
+                 void *valueP)
+{
+    (void)interp;
+    (void)tclhCtxP;
+    (void)argP;
+    *(Tcl_Obj **)valueP = objP;
+    return TCL_OK;
+}
+
+static Tcl_Obj *
+TclhMarshalFromObj(const TclhMarshalArg *argP, const void *valueP)
+{
+    Tcl_Obj *objP = *(Tcl_Obj *const *)valueP;
+    (void)argP;
+    return objP ? objP : Tclh_ObjEmpty();
+}
+
+#ifdef TCLHPOINTER_H
+static Tclh_ReturnCode
+TclhMarshalToPointer(Tcl_Interp *interp,
+                     Tclh_LibContext *tclhCtxP,
+                     const TclhMarshalArg *argP,
+                     Tcl_Obj *objP,
+                     void *valueP)
+{
+    if (argP->tagObj == NULL)
+        return Tclh_PointerUnwrap(interp, objP, (void **)valueP);
+    return Tclh_PointerUnwrapTagged(
+        interp, tclhCtxP, objP, (void **)valueP, NULL, argP->tagObj);
+}
+
+static Tcl_Obj *
+TclhMarshalFromPointer(const TclhMarshalArg *argP, const void *valueP)
+{
+    return Tclh_PointerWrap(*(void *const *)valueP, argP->tagObj);
+}
+#endif
+
+static const struct {
+    char code;
+    unsigned char size;
+    unsigned char align;
+    TclhMarshalToNativeProc *toNativeProc;
+    TclhMarshalFromNativeProc *fromNativeProc;
+} gTclhMarshalTypes[] = {
+#define TCLH_MARSHAL_TYPE(code_, ctype_, name_)                                \
+    {code_,                                                                    \
+     sizeof(ctype_),                                                           \
+     TCLH_MARSHAL_ALIGNOF(ctype_),                                             \
+     TclhMarshalTo##name_,                                                     \
+     TclhMarshalFrom##name_}
+    TCLH_MARSHAL_TYPE('c', signed char, SChar),
+    TCLH_MARSHAL_TYPE('C', unsigned char, UChar),
+    TCLH_MARSHAL_TYPE('h', short, Short),
+    TCLH_MARSHAL_TYPE('H', unsigned short, UShort),
+    TCLH_MARSHAL_TYPE('i', int, Int),
+    TCLH_MARSHAL_TYPE('u', unsigned int, UInt),
+    TCLH_MARSHAL_TYPE('l', long, Long),
+    TCLH_MARSHAL_TYPE('L', unsigned long, ULong),
+    TCLH_MARSHAL_TYPE('w', signed long long, LongLong),
+    TCLH_MARSHAL_TYPE('W', unsigned long long, ULongLong),
+    TCLH_MARSHAL_TYPE('f', float, Float),
+    TCLH_MARSHAL_TYPE('d', double, Double),
+    TCLH_MARSHAL_TYPE('s', const char *, String),
+    TCLH_MARSHAL_TYPE('o', Tcl_Obj *, Obj),
+#ifdef TCLHPOINTER_H
+    TCLH_MARSHAL_TYPE('p', void *, Pointer),
+#endif
+#undef TCLH_MARSHAL_TYPE
+};
+
+/*
+ * Parses the type code at *pP filling in the converters and pointer tag in
+ * argP and returning the size and alignment of the native type. On success
+ * *pP is updated to point past the type code (and terminating ; if any).
+ * sig is only used for error messages.
+ */
+static Tclh_ReturnCode
+TclhMarshalParseCode(Tcl_Interp *interp,
+                     const char *sig,
+                     const char **pP,
+                     TclhMarshalArg *argP,
+                     size_t *sizeP,
+                     size_t *alignP)
+{
+    const char *p = *pP;
+    const int ntypes =
+        (int)(sizeof(gTclhMarshalTypes) / sizeof(gTclhMarshalTypes[0]));
+    int i;
+
+    for (i = 0; i < ntypes; ++i) {
+        if (gTclhMarshalTypes[i].code == *p)
+            break;
+    }
+    if (i == ntypes) {
+        return Tclh_ErrorInvalidValueStr(
+            interp, sig, "Invalid type code in marshalling signature.");
+    }
+
+    argP->tagObj = NULL;
+    ++p;
+    if (*p == '^' && p[-1] == 'p') {
+        const char *tag = p + 1;
+        const char *end = strchr(tag, ';');
+        if (end == NULL)
+            end = tag + strlen(tag);
+        if (end == tag) {
+            return Tclh_ErrorInvalidValueStr(
+                interp, sig, "Empty pointer tag in marshalling signature.");
+        }
+        argP->tagObj = Tcl_NewStringObj(tag, (Tcl_Size)(end - tag));
+        Tcl_IncrRefCount(argP->tagObj);
+        p = *end ? end + 1 : end;
+    }
+
+    argP->offset         = 0;
+    argP->toNativeProc   = gTclhMarshalTypes[i].toNativeProc;
+    argP->fromNativeProc = gTclhMarshalTypes[i].fromNativeProc;
+    *sizeP               = gTclhMarshalTypes[i].size;
+    *alignP              = gTclhMarshalTypes[i].align;
+    *pP                  = p;
+    return TCL_OK;
+}
+
+Tclh_ReturnCode
+Tclh_MarshalSigCompile(Tcl_Interp *interp,
+                       Tclh_LibContext *tclhCtxP,
+                       const char *sig,
+                       Tclh_MarshalSig **sigPP)
+{
+    Tclh_MarshalSig *sigP;
+    const char *p;
+    size_t offset, maxAlign;
+    Tcl_Size nargs;
+
+    /* Number of type codes cannot exceed length of signature */
+    nargs = (Tcl_Size)strlen(sig);
+    sigP  = (Tclh_MarshalSig *)Tcl_Alloc(
+        offsetof(Tclh_MarshalSig, args)
+        + (nargs ? nargs : 1) * sizeof(sigP->args[0]));
+    sigP->tclhCtxP  = tclhCtxP;
+    sigP->nargs     = 0;
+    sigP->blockSize = 0;
+
+    offset   = 0;
+    maxAlign = 1;
+    p        = sig;
+    while (*p) {
+        TclhMarshalArg *argP = &sigP->args[sigP->nargs];
+        size_t size, align;
+
+        if (TclhMarshalParseCode(interp, sig, &p, argP, &size, &align)
+            != TCL_OK) {
+            goto error_return;
+        }
+        sigP->nargs++;
+        if (align > maxAlign)
+            maxAlign = align;
+        offset       = (offset + align - 1) & ~(align - 1);
+        argP->offset = offset;
+        offset += size;
+    }
+    sigP->blockSize = (offset + maxAlign - 1) & ~(maxAlign - 1);
+    *sigPP = sigP;
+    return TCL_OK;
+
+error_return:
+    Tclh_MarshalSigFree(sigP);
+    return TCL_ERROR;
+}
+
+void
+Tclh_MarshalSigFree(Tclh_MarshalSig *sigP)
+{
+    Tcl_Size i;
+    if (sigP == NULL)
+        return;
+    for (i = 0; i < sigP->nargs; ++i) {
+        if (sigP->args[i].tagObj)
+            Tcl_DecrRefCount(sigP->args[i].tagObj);
+    }
+    Tcl_Free((char *)sigP);
+}
+
+Tcl_Size
+Tclh_MarshalSigNumArgs(const Tclh_MarshalSig *sigP)
+{
+    return sigP->nargs;
+}
+
+size_t
+Tclh_MarshalSigBlockSize(const Tclh_MarshalSig *sigP)
+{
+    return sigP->blockSize;
+}
+
+size_t
+Tclh_MarshalSigArgOffset(const Tclh_MarshalSig *sigP, Tcl_Size argIndex)
+{
+    TCLH_ASSERT(argIndex >= 0 && argIndex < sigP->nargs);
+    return sigP->args[argIndex].offset;
+}
+
+Tclh_ReturnCode
+Tclh_MarshalObjv(Tcl_Interp *interp,
+                 const Tclh_MarshalSig *sigP,
+                 Tcl_Size objc,
+                 Tcl_Obj *const objv[],
+                 void *blockP)
+{
+    const TclhMarshalArg *argP;
+    const TclhMarshalArg *endP;
+
+    if (objc != sigP->nargs) {
+        return Tclh_ErrorGeneric(
+            interp,
+            "ARGCOUNT",
+            "Number of values does not match marshalling signature.");
+    }
+    endP = sigP->args + sigP->nargs;
+    for (argP = sigP->args; argP < endP; ++argP, ++objv) {
+        if (argP->toNativeProc(interp,
+                               sigP->tclhCtxP,
+                               argP,
+                               *objv,
+                               (char *)blockP + argP->offset)
+            != TCL_OK)
+            return TCL_ERROR;
+    }
+    return TCL_OK;
+}
+
+void
+Tclh_MarshalToObjv(const Tclh_MarshalSig *sigP,
+                   const void *blockP,
+                   Tcl_Obj *objv[])
+{
+    const TclhMarshalArg *argP;
+    const TclhMarshalArg *endP;
+
+    endP = sigP->args + sigP->nargs;
+    for (argP = sigP->args; argP < endP; ++argP, ++objv) {
+        *objv = argP->fromNativeProc(argP,
+                                     (const char *)blockP + argP->offset);
+    }
+}
+
+Tcl_Obj *
+Tclh_MarshalToList(const Tclh_MarshalSig *sigP, const void *blockP)
+{
+#define TCLH_MARSHAL_STATIC 16
+    Tcl_Obj *staticObjs[TCLH_MARSHAL_STATIC];
+    Tcl_Obj **objs;
+    Tcl_Obj *listObj;
+
+    if (sigP->nargs > TCLH_MARSHAL_STATIC)
+        objs = (Tcl_Obj **)Tcl_Alloc(sigP->nargs * sizeof(*objs));
+    else
+        objs = staticObjs;
+    Tclh_MarshalToObjv(sigP, blockP, objs);
+    listObj = Tcl_NewListObj(sigP->nargs, objs);
+    if (objs != staticObjs)
+        Tcl_Free((char *)objs);
+    return listObj;
+}
+
+/*
+ * Struct layouts: Tcl_Obj custom type
+ * The internal representation is a reference counted TclhStructLayout
+ * stored in Tcl_Obj.internalRep.twoPtrValue.ptr1. Nested struct layouts
+ * are owned by the containing layout.
+ */
+typedef struct TclhStructLayout TclhStructLayout;
+
+typedef struct TclhStructField {
+    Tcl_Obj *nameObj;          /* Field name, used as the dictionary key */
+    Tcl_Obj *typeObj;          /* Field type definition */
+    TclhMarshalArg scalar;     /* Converters for scalar fields. The offset is
+                                  that of the field for all field types. */
+    TclhStructLayout *nestedP; /* Layout of nested struct, NULL for scalars */
+    Tcl_Size arraySize;        /* Number of elements if array, else 0 */
+    size_t elemSize;           /* Size of a single element */
+} TclhStructField;
+
+struct TclhStructLayout {
+    Tcl_Size nRefs;             /* Number of Tcl_Obj's referencing this */
+    Tcl_Size nfields;           /* Number of elements in fields[] */
+    size_t size;                /* Size of struct including padding */
+    size_t align;               /* Alignment of struct */
+    TclhStructField fields[1];  /* Actually nfields elements */
+};
+
+static void DupStructLayoutObj(Tcl_Obj *srcObj, Tcl_Obj *dstObj);
+static void FreeStructLayoutObj(Tcl_Obj *objP);
+static void StringFromStructLayoutObj(Tcl_Obj *objP);
+
+static struct Tcl_ObjType gStructLayoutVtbl = {
+    "Tclh_StructLayout",
+    FreeStructLayoutObj,
+    DupStructLayoutObj,
+    StringFromStructLayoutObj,
+    NULL
+};
+TCLH_INLINE TclhStructLayout *IntrepGetStructLayout(Tcl_Obj *objP) {
+    return (TclhStructLayout *) objP->internalRep.twoPtrValue.ptr1;
+}
+TCLH_INLINE void IntrepSetStructLayout(Tcl_Obj *objP, TclhStructLayout *layoutP) {
+    objP->internalRep.twoPtrValue.ptr1 = (void *) layoutP;
+    objP->internalRep.twoPtrValue.ptr2 = NULL;
+}
+
+static void
+TclhStructLayoutRelease(TclhStructLayout *layoutP)
+{
+    Tcl_Size i;
+
+    if (--layoutP->nRefs > 0)
+        return;
+    for (i = 0; i < layoutP->nfields; ++i) {
+        TclhStructField *fieldP = &layoutP->fields[i];
+        Tcl_DecrRefCount(fieldP->nameObj);
+        Tcl_DecrRefCount(fieldP->typeObj);
+        if (fieldP->scalar.tagObj)
+            Tcl_DecrRefCount(fieldP->scalar.tagObj);
+        if (fieldP->nestedP)
+            TclhStructLayoutRelease(fieldP->nestedP);
+    }
+    Tcl_Free((char *)layoutP);
+}
+
+static Tclh_ReturnCode TclhStructLayoutCompile(Tcl_Interp *interp,
+                                               Tcl_Obj *defObj,
+                                               TclhStructLayout **layoutPP);
+
+/*
+ * Parses the type of a single element (scalar or nested struct) into
+ * fieldP returning its size and alignment.
+ */
+static Tclh_ReturnCode
+TclhStructParseElemType(Tcl_Interp *interp,
+                        Tcl_Obj *typeObj,
+                        TclhStructField *fieldP,
+                        size_t *sizeP,
+                        size_t *alignP)
+{
+    Tcl_Obj **elems;
+    Tcl_Size nelems;
+
+    if (Tcl_ListObjGetElements(interp, typeObj, &nelems, &elems) != TCL_OK)
+        return TCL_ERROR;
+    if (nelems == 2 && !strcmp(Tcl_GetString(elems[0]), "struct")) {
+        if (TclhStructLayoutCompile(interp, elems[1], &fieldP->nestedP)
+            != TCL_OK)
+            return TCL_ERROR;
+        *sizeP  = fieldP->nestedP->size;
+        *alignP = fieldP->nestedP->align;
+        return TCL_OK;
+    }
+    if (nelems == 1) {
+        const char *code = Tcl_GetString(elems[0]);
+        const char *p    = code;
+        if (TclhMarshalParseCode(
+                interp, code, &p, &fieldP->scalar, sizeP, alignP)
+            != TCL_OK)
+            return TCL_ERROR;
+        if (*p == '\0')
+            return TCL_OK;
+        /* More than one type code. */
+        if (fieldP->scalar.tagObj) {
+            Tcl_DecrRefCount(fieldP->scalar.tagObj);
+            fieldP->scalar.tagObj = NULL;
+        }
+    }
+    return Tclh_ErrorInvalidValue(interp, typeObj, "Invalid struct field type.");
+}
+
+static Tclh_ReturnCode
+TclhStructLayoutCompile(Tcl_Interp *interp,
+                        Tcl_Obj *defObj,
+                        TclhStructLayout **layoutPP)
+{
+    TclhStructLayout *layoutP;
+    Tcl_Obj **objs;
+    Tcl_Size i, nobjs;
+    size_t offset;
+    int useAtoms;
+
+    if (Tcl_ListObjGetElements(interp, defObj, &nobjs, &objs) != TCL_OK)
+        return TCL_ERROR;
+    if (nobjs == 0 || (nobjs & 1)) {
+        return Tclh_ErrorInvalidValue(
+            interp,
+            defObj,
+            "Struct definition must be a non-empty list of field names "
+            "and types.");
+    }
+
+    layoutP = (TclhStructLayout *)Tcl_Alloc(
+        offsetof(TclhStructLayout, fields)
+        + (nobjs / 2) * sizeof(layoutP->fields[0]));
+    layoutP->nRefs   = 1;
+    layoutP->nfields = 0;
+    layoutP->align   = 1;
+    offset           = 0;
+
+    /*
+     * Field names are atomized so dictionaries for all layouts, and other
+     * users of the registry, share a single Tcl_Obj per name. Atoms need
+     * an interpreter. Without one the names in the definition are used.
+     */
+    useAtoms = 0;
+    if (interp) {
+        if (Tclh_AtomLibInit(interp, NULL) == TCL_OK)
+            useAtoms = 1;
+        else
+            Tcl_ResetResult(interp);
+    }
+
+    for (i = 0; i < nobjs; i += 2) {
+        TclhStructField *fieldP = &layoutP->fields[layoutP->nfields];
+        Tcl_Obj *typeObj        = objs[i + 1];
+        Tcl_Obj **elems;
+        Tcl_Size nelems;
+        size_t size, align;
+
+        fieldP->nameObj   = objs[i];
+        if (useAtoms) {
+            Tcl_Obj *atomObj = Tclh_AtomFromObj(interp, NULL, objs[i]);
+            if (atomObj)
+                fieldP->nameObj = atomObj;
+        }
+        fieldP->typeObj   = typeObj;
+        fieldP->nestedP   = NULL;
+        fieldP->arraySize = 0;
+        fieldP->scalar.tagObj = NULL;
+        Tcl_IncrRefCount(fieldP->nameObj);
+        Tcl_IncrRefCount(fieldP->typeObj);
+        layoutP->nfields++; /* So it is cleaned up on errors */
+
+        if (Tcl_ListObjGetElements(interp, typeObj, &nelems, &elems) != TCL_OK)
+            goto error_return;
+        if (nelems == 3 && !strcmp(Tcl_GetString(elems[0]), "array")) {
+            Tcl_Size count;
+            if (Tclh_ObjToSizeInt(interp, elems[1], &count) != TCL_OK)
+                goto error_return;
+            if (count <= 0) {
+                Tclh_ErrorInvalidValue(
+                    interp, elems[1], "Array size must be positive.");
+                goto error_return;
+            }
+            if (TclhStructParseElemType(interp, elems[2], fieldP, &size, &align)
+                != TCL_OK)
+                goto error_return;
+            if ((size_t)count > TCL_SIZE_MAX / size) {
+                Tclh_ErrorGeneric(
+                    interp, "LIMIT", "Struct array size is too large.");
+                goto error_return;
+            }
+            fieldP->arraySize = count;
+            fieldP->elemSize  = size;
+            size *= count;
+        }
+        else {
+            if (TclhStructParseElemType(interp, typeObj, fieldP, &size, &align)
+                != TCL_OK)
+                goto error_return;
+            fieldP->elemSize = size;
+        }
+
+        if (align > layoutP->align)
+            layoutP->align = align;
+        offset = (offset + align - 1) & ~(align - 1);
+        fieldP->scalar.offset = offset;
+        if (offset > TCL_SIZE_MAX || size > TCL_SIZE_MAX - offset) {
+            Tclh_ErrorGeneric(interp, "LIMIT", "Struct size is too large.");
+            goto error_return;
+        }
+        offset += size;
+    }
+    layoutP->size = (offset + layoutP->align - 1) & ~(layoutP->align - 1);
+    *layoutPP = layoutP;
+    return TCL_OK;
+
+error_return:
+    TclhStructLayoutRelease(layoutP);
+    return TCL_ERROR;
+}
+
+static void DupStructLayoutObj(Tcl_Obj *srcObj, Tcl_Obj *dstObj)
+{
+    TclhStructLayout *layoutP = IntrepGetStructLayout(srcObj);
+    layoutP->nRefs++;
+    IntrepSetStructLayout(dstObj, layoutP);
+    dstObj->typePtr = &gStructLayoutVtbl;
+}
+
+static void FreeStructLayoutObj(Tcl_Obj *objP)
+{
+    TclhStructLayout *layoutP = IntrepGetStructLayout(objP);
+    if (layoutP)
+        TclhStructLayoutRelease(layoutP);
+    IntrepSetStructLayout(objP, NULL);
+    objP->typePtr = NULL;
+}
+
+static void StringFromStructLayoutObj(Tcl_Obj *objP)
+{
+    /* Not likely to be called as string rep is kept on conversion */
+    TclhStructLayout *layoutP = IntrepGetStructLayout(objP);
+    Tcl_Obj *listObj = Tcl_NewListObj(0, NULL);
+    Tcl_Size i;
+
+    for (i = 0; i < layoutP->nfields; ++i) {
+        Tcl_ListObjAppendElement(NULL, listObj, layoutP->fields[i].nameObj);
+        Tcl_ListObjAppendElement(NULL, listObj, layoutP->fields[i].typeObj);
+    }
+    Tcl_GetString(listObj);
+    objP->length = listObj->length;
+    objP->bytes = Tcl_Alloc(listObj->length + 1);
+    memcpy(objP->bytes, listObj->bytes, listObj->length + 1);
+    Tcl_DecrRefCount(listObj);
+}
+
+static Tclh_ReturnCode
+TclhStructLayoutFromObj(Tcl_Interp *interp,
+                        Tcl_Obj *objP,
+                        TclhStructLayout **layoutPP)
+{
+    TclhStructLayout *layoutP;
+
+    if (objP->typePtr != &gStructLayoutVtbl) {
+        if (TclhStructLayoutCompile(interp, objP, &layoutP) != TCL_OK)
+            return TCL_ERROR;
+        (void) Tcl_GetString(objP); /* Keep string rep before losing list */
+        if (objP->typePtr && objP->typePtr->freeIntRepProc)
+            objP->typePtr->freeIntRepProc(objP);
+        IntrepSetStructLayout(objP, layoutP);
+        objP->typePtr = &gStructLayoutVtbl;
+    }
+    *layoutPP = IntrepGetStructLayout(objP);
+    return TCL_OK;
+}
+
+Tclh_ReturnCode
+Tclh_MarshalStructSize(Tcl_Interp *interp,
+                       Tcl_Obj *layoutObj,
+                       size_t *sizeP,
+                       size_t *alignP)
+{
+    TclhStructLayout *layoutP;
+    if (TclhStructLayoutFromObj(interp, layoutObj, &layoutP) != TCL_OK)
+        return TCL_ERROR;
+    *sizeP = layoutP->size;
+    if (alignP)
+        *alignP = layoutP->align;
+    return TCL_OK;
+}
+
+static Tclh_ReturnCode
+TclhStructFromDict(Tcl_Interp *interp,
+                   Tclh_LibContext *tclhCtxP,
+                   const TclhStructLayout *layoutP,
+                   Tcl_Obj *dictObj,
+                   char *baseP)
+{
+    const TclhStructField *fieldP;
+    const TclhStructField *endP = layoutP->fields + layoutP->nfields;
+
+    for (fieldP = layoutP->fields; fieldP < endP; ++fieldP) {
+        Tcl_Obj *valueObj;
+        Tcl_Obj **elems;
+        Tcl_Size i, nelems;
+        char *p = baseP + fieldP->scalar.offset;
+
+        if (Tcl_DictObjGet(interp, dictObj, fieldP->nameObj, &valueObj)
+            != TCL_OK)
+            return TCL_ERROR;
+        if (valueObj == NULL)
+            return Tclh_ErrorNotFound(interp, "Field", fieldP->nameObj, NULL);
+
+        if (fieldP->arraySize == 0) {
+            elems  = &valueObj;
+            nelems = 1;
+        }
+        else {
+            if (Tcl_ListObjGetElements(interp, valueObj, &nelems, &elems)
+                != TCL_OK)
+                return TCL_ERROR;
+            if (nelems != fieldP->arraySize) {
+                return Tclh_ErrorInvalidValue(
+                    interp,
+                    valueObj,
+                    "Number of elements does not match struct array size.");
+            }
+        }
+        for (i = 0; i < nelems; ++i, p += fieldP->elemSize) {
+            Tclh_ReturnCode ret;
+            if (fieldP->nestedP)
+                ret = TclhStructFromDict(
+                    interp, tclhCtxP, fieldP->nestedP, elems[i], p);
+            else
+                ret = fieldP->scalar.toNativeProc(
+                    interp, tclhCtxP, &fieldP->scalar, elems[i], p);
+            if (ret != TCL_OK)
+                return TCL_ERROR;
+        }
+    }
+    return TCL_OK;
+}
+
+static Tcl_Obj *
+TclhStructToDict(const TclhStructLayout *layoutP, const char *baseP)
+{
+#define TCLH_STRUCT_ARRAY_STATIC 16
+    const TclhStructField *fieldP;
+    const TclhStructField *endP = layoutP->fields + layoutP->nfields;
+    Tcl_Obj *dictObj = Tcl_NewDictObj();
+
+    for (fieldP = layoutP->fields; fieldP < endP; ++fieldP) {
+        Tcl_Obj *staticObjs[TCLH_STRUCT_ARRAY_STATIC];
+        Tcl_Obj **objs;
+        Tcl_Obj *valueObj;
+        Tcl_Size i, nelems;
+        const char *p = baseP + fieldP->scalar.offset;
+
+        nelems = fieldP->arraySize ? fieldP->arraySize : 1;
+        if (nelems > TCLH_STRUCT_ARRAY_STATIC)
+            objs = (Tcl_Obj **)Tcl_Alloc(nelems * sizeof(*objs));
+        else
+            objs = staticObjs;
+        for (i = 0; i < nelems; ++i, p += fieldP->elemSize) {
+            if (fieldP->nestedP)
+                objs[i] = TclhStructToDict(fieldP->nestedP, p);
+            else
+                objs[i] = fieldP->scalar.fromNativeProc(&fieldP->scalar, p);
+        }
+        if (fieldP->arraySize)
+            valueObj = Tcl_NewListObj(nelems, objs);
+        else
+            valueObj = objs[0];
+        if (objs != staticObjs)
+            Tcl_Free((char *)objs);
+        Tcl_DictObjPut(NULL, dictObj, fieldP->nameObj, valueObj);
+    }
+    return dictObj;
+}
+
+Tclh_ReturnCode
+Tclh_MarshalDictToStruct(Tcl_Interp *interp,
+                         Tclh_LibContext *tclhCtxP,
+                         Tcl_Obj *layoutObj,
+                         Tcl_Obj *dictObj,
+                         void *structP)
+{
+    TclhStructLayout *layoutP;
+    Tclh_ReturnCode ret;
+
+    if (TclhStructLayoutFromObj(interp, layoutObj, &layoutP) != TCL_OK)
+        return TCL_ERROR;
+    /* Protect against layoutObj shimmering if it is also used as a value */
+    layoutP->nRefs++;
+    ret = TclhStructFromDict(interp, tclhCtxP, layoutP, dictObj, structP);
+    TclhStructLayoutRelease(layoutP);
+    return ret;
+}
+
+Tclh_ReturnCode
+Tclh_MarshalStructToDict(Tcl_Interp *interp,
+                         Tcl_Obj *layoutObj,
+                         const void *structP,
+                         Tcl_Obj **dictObjP)
+{
+    TclhStructLayout *layoutP;
+
+    if (TclhStructLayoutFromObj(interp, layoutObj, &layoutP) != TCL_OK)
+        return TCL_ERROR;
+    *dictObjP = TclhStructToDict(layoutP, structP);
+    return TCL_OK;
+}
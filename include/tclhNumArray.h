@@ -0,0 +1,179 @@
+#ifndef TCLHNUMARRAY_H
+#define TCLHNUMARRAY_H
+
+/*
+ * Copyright (c) 2024, Ashok P. Nadkarni
+ * All rights reserved.
+ *
+ * See the file LICENSE for license
+ */
+
+#include "tclhBase.h"
+#include "tclhObj.h"
+
+/* Section: Numeric arrays
+ *
+ * Provides a custom Tcl_Obj type that stores a contiguous C array of
+ * a numeric <Tclh_NativeType> as its internal representation. Numeric data
+ * can then be passed between C functions through the Tcl level without
+ * conversion to a list of individual Tcl_Obj values. The string (and hence
+ * list) representation is only generated when demanded by the script level.
+ *
+ * Any Tcl list of numbers can be passed where a numeric array is expected
+ * and will be converted on first use. The Obj module must be initialized
+ * with <Tclh_ObjLibInit> before using these functions.
+ */
+
+/* Function: Tclh_NumArrayNewObj
+ * Returns a Tcl_Obj wrapping a C numeric array.
+ *
+ * Parameters:
+ * type - the <Tclh_NativeType> of the array elements
+ * valuesP - pointer to the values to be copied into the Tcl_Obj. If NULL,
+ *    the array is initialized to zeroes.
+ * count - number of elements in the array
+ *
+ * Returns:
+ * A pointer to a Tcl_Obj with a zero reference count or NULL if *type*
+ * is not a valid <Tclh_NativeType>.
+ */
+TCLH_LOCAL Tcl_Obj *
+Tclh_NumArrayNewObj(Tclh_NativeType type, const void *valuesP, Tcl_Size count);
+
+/* Function: Tclh_NumArrayGetRef
+ * Returns a pointer to the C array held in a Tcl_Obj.
+ *
+ * Parameters:
+ * interp - Interpreter for error messages. May be NULL.
+ * objP - the Tcl_Obj holding the array
+ * type - the <Tclh_NativeType> expected for the array elements
+ * countP - location to store number of elements in the array. May be NULL.
+ *
+ * If *objP* does not already hold a numeric array of the requested type,
+ * it is converted from its list (or numeric array of a different type)
+ * form. Conversion follows the same rules as <Tclh_ObjListToNativeArray>.
+ *
+ * The returned pointer refers to the internal storage of *objP* and must
+ * not be modified. It is only valid as long as the internal representation
+ * of *objP* is not changed.
+ *
+ * Returns:
+ * Pointer to the array on success, or NULL on error with an error message
+ * in the interpreter. Note the returned pointer for an empty array is
+ * not NULL.
+ */
+TCLH_LOCAL const void *Tclh_NumArrayGetRef(Tcl_Interp *interp,
+                                           Tcl_Obj *objP,
+                                           Tclh_NativeType type,
+                                           Tcl_Size *countP);
+
+/* Function: Tclh_NumArrayGetWritable
+ * Returns a pointer to the C array held in a Tcl_Obj for modification.
+ *
+ * Parameters:
+ * interp - Interpreter for error messages. May be NULL.
+ * objP - the Tcl_Obj holding the array. Must not be shared.
+ * type - the <Tclh_NativeType> expected for the array elements
+ * countP - location to store number of elements in the array. May be NULL.
+ *
+ * As for <Tclh_NumArrayGetRef> except that the caller may modify the
+ * contents of the returned array. The string representation of *objP*
+ * is invalidated. If the storage is shared with duplicates of *objP*, it
+ * is copied first.
+ *
+ * Returns:
+ * Pointer to the array on success, or NULL on error with an error message
+ * in the interpreter.
+ */
+TCLH_LOCAL void *Tclh_NumArrayGetWritable(Tcl_Interp *interp,
+                                          Tcl_Obj *objP,
+                                          Tclh_NativeType type,
+                                          Tcl_Size *countP);
+
+/* Function: Tclh_NumArrayIsObjIntrep
+ * Checks if the passed Tcl_Obj currently holds an internal representation
+ * of a numeric array.
+ *
+ * Parameters:
+ * objP - the Tcl_Obj to be checked.
+ * typeP - location to store the <Tclh_NativeType> of the array elements
+ *    if the function returns 1. May be NULL.
+ *
+ * Returns:
+ * 1 - Current internal representation holds a numeric array.
+ * 0 - otherwise.
+ */
+TCLH_LOCAL Tclh_Bool Tclh_NumArrayIsObjIntrep(Tcl_Obj *objP,
+                                              Tclh_NativeType *typeP);
+
+/* Function: Tclh_NumArrayToList
+ * Returns a Tcl list containing the elements of a numeric array.
+ *
+ * Parameters:
+ * interp - Interpreter for error messages. May be NULL.
+ * objP - the Tcl_Obj holding the array
+ *
+ * The list is constructed directly from the native array without
+ * going through the string representation.
+ *
+ * Returns:
+ * A Tcl list with a zero reference count, or NULL with an error message
+ * in the interpreter if *objP* does not hold a numeric array.
+ */
+TCLH_LOCAL Tcl_Obj *Tclh_NumArrayToList(Tcl_Interp *interp, Tcl_Obj *objP);
+
+/* Function: Tclh_NativeArrayConvert
+ * Converts a C array of one numeric type to another.
+ *
+ * Parameters:
+ * interp - Interpreter for error messages. May be NULL.
+ * dstType - the <Tclh_NativeType> of the destination array
+ * dstP - destination array with room for *count* elements
+ * srcType - the <Tclh_NativeType> of the source array
+ * srcP - source array. Must not overlap *dstP* unless the two types
+ *    are the same.
+ * count - number of elements to convert
+ * checkRange - if true, the conversion fails if any source value does not
+ *    fit in the destination type. Floating point values converted to an
+ *    integer type must also have no fractional part. Infinities and NaN
+ *    are permitted when converting double to float. If false, integer
+ *    values are converted following C casting rules while floating point
+ *    values saturate at the limits of the destination type, with NaN
+ *    converted to 0 for integer types.
+ * badIndexP - location to store the index of the first value that is out
+ *    of range on failure. May be NULL.
+ *
+ * The conversion loops are written as simple element-wise loops over
+ * packed arrays with no per-element calls so that they are vectorized by
+ * the compiler. The range check is done as a separate pass in blocks
+ * so that it is also amenable to vectorization.
+ *
+ * On error, the contents of *dstP* are unchanged.
+ *
+ * Returns:
+ * TCL_OK on success, TCL_ERROR with an error message in the interpreter
+ * if a value is out of range or a type is invalid.
+ */
+TCLH_LOCAL Tclh_ReturnCode Tclh_NativeArrayConvert(Tcl_Interp *interp,
+                                                   Tclh_NativeType dstType,
+                                                   void *dstP,
+                                                   Tclh_NativeType srcType,
+                                                   const void *srcP,
+                                                   Tcl_Size count,
+                                                   Tclh_Bool checkRange,
+                                                   Tcl_Size *badIndexP);
+
+#ifdef TCLH_SHORTNAMES
+#define NativeArrayConvert   Tclh_NativeArrayConvert
+#define NumArrayNewObj       Tclh_NumArrayNewObj
+#define NumArrayGetRef       Tclh_NumArrayGetRef
+#define NumArrayGetWritable  Tclh_NumArrayGetWritable
+#define NumArrayIsObjIntrep  Tclh_NumArrayIsObjIntrep
+#define NumArrayToList       Tclh_NumArrayToList
+#endif
+
+#ifdef TCLH_IMPL
+#include "tclhNumArrayImpl.c"
+#endif
+
+#endif /* TCLHNUMARRAY_H */
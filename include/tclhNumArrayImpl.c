@@ -0,0 +1,638 @@
+/*
+ * Copyright (c) 2024, Ashok P. Nadkarni
+ * All rights reserved.
+ *
+ * See the file LICENSE for license
+ */
+
+#include "tclhNumArray.h"
+#include <stddef.h>
+#include <float.h>
+#include <math.h>
+
+/*
+ * NumArray: Tcl_Obj custom type
+ * The internal representation is a pointer to a TclhNumArray stored in
+ * Tcl_Obj.internalRep.twoPtrValue.ptr1. The TclhNumArray is reference
+ * counted so duplicated Tcl_Obj values share the storage until one of
+ * them is modified.
+ */
+typedef struct TclhNumArray {
+    Tcl_Size nRefs;       /* Number of Tcl_Obj's referencing this array */
+    Tcl_Size count;       /* Number of elements */
+    Tclh_NativeType type; /* Type of elements */
+    union {               /* Only for alignment, actual size is count */
+        double d;
+        long long ll;
+        void *pv;
+    } values[1];
+} TclhNumArray;
+
+static void DupNumArrayObj(Tcl_Obj *srcObj, Tcl_Obj *dstObj);
+static void FreeNumArrayObj(Tcl_Obj *objP);
+static void StringFromNumArrayObj(Tcl_Obj *objP);
+static int SetNumArrayObjFromAny(Tcl_Interp *interp,
+                                 Tcl_Obj *objP,
+                                 Tclh_NativeType type);
+
+static struct Tcl_ObjType gNumArrayVtbl = {
+    "Tclh_NumArray",
+    FreeNumArrayObj,
+    DupNumArrayObj,
+    StringFromNumArrayObj,
+    NULL
+};
+TCLH_INLINE TclhNumArray *IntrepGetNumArray(Tcl_Obj *objP) {
+    return (TclhNumArray *) objP->internalRep.twoPtrValue.ptr1;
+}
+TCLH_INLINE void IntrepSetNumArray(Tcl_Obj *objP, TclhNumArray *arrP) {
+    objP->internalRep.twoPtrValue.ptr1 = (void *) arrP;
+    objP->internalRep.twoPtrValue.ptr2 = NULL;
+}
+
+/* Allocates an array with a reference count of 0. Contents uninitialized */
+static TclhNumArray *
+NumArrayAlloc(Tclh_NativeType type, Tcl_Size count)
+{
+    TclhNumArray *arrP;
+    size_t dataSize = count * Tclh_NativeTypeSize(type);
+    if (dataSize < sizeof(arrP->values))
+        dataSize = sizeof(arrP->values);
+    arrP = (TclhNumArray *)Tcl_Alloc(offsetof(TclhNumArray, values) + dataSize);
+    arrP->nRefs = 0;
+    arrP->count = count;
+    arrP->type = type;
+    return arrP;
+}
+
+/* Replaces the internal rep of objP with arrP. */
+static void
+NumArrayObjSetIntrep(Tcl_Obj *objP, TclhNumArray *arrP)
+{
+    if (objP->typePtr && objP->typePtr->freeIntRepProc) {
+        objP->typePtr->freeIntRepProc(objP);
+    }
+    arrP->nRefs++;
+    IntrepSetNumArray(objP, arrP);
+    objP->typePtr = &gNumArrayVtbl;
+}
+
+Tclh_Bool Tclh_NumArrayIsObjIntrep(Tcl_Obj *objP, Tclh_NativeType *typeP)
+{
+    if (objP->typePtr != &gNumArrayVtbl)
+        return 0;
+    if (typeP)
+        *typeP = IntrepGetNumArray(objP)->type;
+    return 1;
+}
+
+static void DupNumArrayObj(Tcl_Obj *srcObj, Tcl_Obj *dstObj)
+{
+    TclhNumArray *arrP = IntrepGetNumArray(srcObj);
+    arrP->nRefs++;
+    IntrepSetNumArray(dstObj, arrP);
+    dstObj->typePtr = &gNumArrayVtbl;
+}
+
+static void FreeNumArrayObj(Tcl_Obj *objP)
+{
+    TclhNumArray *arrP = IntrepGetNumArray(objP);
+    if (arrP && --arrP->nRefs <= 0)
+        Tcl_Free((char *)arrP);
+    IntrepSetNumArray(objP, NULL);
+    objP->typePtr = NULL;
+}
+
+static void StringFromNumArrayObj(Tcl_Obj *objP)
+{
+    TclhNumArray *arrP = IntrepGetNumArray(objP);
+    Tcl_DString ds;
+    Tcl_Size i;
+    char buf[TCL_DOUBLE_SPACE + 40];
+
+    Tcl_DStringInit(&ds);
+
+#define TCLH_FORMAT_ELEMS(ctype_, fmt_, fmttype_)                             \
+    do {                                                                      \
+        const ctype_ *p_ = (const ctype_ *)arrP->values;                      \
+        for (i = 0; i < arrP->count; ++i) {                                   \
+            int len_ = snprintf(buf, sizeof(buf), fmt_, (fmttype_)p_[i]);     \
+            if (i)                                                            \
+                Tcl_DStringAppend(&ds, " ", 1);                               \
+            Tcl_DStringAppend(&ds, buf, len_);                                \
+        }                                                                     \
+    } while (0)
+#define TCLH_FORMAT_SIGNED(ctype_) \
+    TCLH_FORMAT_ELEMS(ctype_, "%" TCL_LL_MODIFIER "d", long long)
+#define TCLH_FORMAT_UNSIGNED(ctype_) \
+    TCLH_FORMAT_ELEMS(ctype_, "%" TCL_LL_MODIFIER "u", unsigned long long)
+#define TCLH_FORMAT_REALS(ctype_)                                             \
+    do {                                                                      \
+        const ctype_ *p_ = (const ctype_ *)arrP->values;                      \
+        for (i = 0; i < arrP->count; ++i) {                                   \
+            /* Same formatting as Tcl's own double string rep */              \
+            Tcl_PrintDouble(NULL, (double)p_[i], buf);                        \
+            if (i)                                                            \
+                Tcl_DStringAppend(&ds, " ", 1);                               \
+            Tcl_DStringAppend(&ds, buf, -1);                                  \
+        }                                                                     \
+    } while (0)
+
+    switch (arrP->type) {
+    case TCLH_NATIVE_SCHAR: TCLH_FORMAT_SIGNED(signed char); break;
+    case TCLH_NATIVE_UCHAR: TCLH_FORMAT_UNSIGNED(unsigned char); break;
+    case TCLH_NATIVE_SHORT: TCLH_FORMAT_SIGNED(short); break;
+    case TCLH_NATIVE_USHORT: TCLH_FORMAT_UNSIGNED(unsigned short); break;
+    case TCLH_NATIVE_INT: TCLH_FORMAT_SIGNED(int); break;
+    case TCLH_NATIVE_UINT: TCLH_FORMAT_UNSIGNED(unsigned int); break;
+    case TCLH_NATIVE_LONG: TCLH_FORMAT_SIGNED(long); break;
+    case TCLH_NATIVE_ULONG: TCLH_FORMAT_UNSIGNED(unsigned long); break;
+    case TCLH_NATIVE_LONGLONG: TCLH_FORMAT_SIGNED(long long); break;
+    case TCLH_NATIVE_ULONGLONG: TCLH_FORMAT_UNSIGNED(unsigned long long); break;
+    case TCLH_NATIVE_FLOAT: TCLH_FORMAT_REALS(float); break;
+    case TCLH_NATIVE_DOUBLE: TCLH_FORMAT_REALS(double); break;
+    }
+
+#undef TCLH_FORMAT_ELEMS
+#undef TCLH_FORMAT_SIGNED
+#undef TCLH_FORMAT_UNSIGNED
+#undef TCLH_FORMAT_REALS
+
+    /*
+     * Poking into DString internals as in Tclh_ObjFromDString to avoid
+     * a copy of what may be a very large buffer.
+     */
+    objP->length = Tcl_DStringLength(&ds);
+    if (ds.string == ds.staticSpace) {
+        objP->bytes = Tclh_strdupn(ds.string, ds.length);
+        Tcl_DStringFree(&ds);
+    }
+    else {
+        objP->bytes = ds.string; /* Transfer ownership, do NOT free ds */
+    }
+}
+
+static int NumArrayTypeIsSigned(Tclh_NativeType type)
+{
+    switch (type) {
+    case TCLH_NATIVE_UCHAR:
+    case TCLH_NATIVE_USHORT:
+    case TCLH_NATIVE_UINT:
+    case TCLH_NATIVE_ULONG:
+    case TCLH_NATIVE_ULONGLONG:
+        return 0;
+    default:
+        return 1;
+    }
+}
+
+static int
+SetNumArrayObjFromAny(Tcl_Interp *interp, Tcl_Obj *objP, Tclh_NativeType type)
+{
+    TclhNumArray *arrP;
+    Tcl_Obj **objs;
+    Tcl_Size i, count;
+    int needString;
+
+    if (objP->typePtr == &gNumArrayVtbl) {
+        TclhNumArray *srcP = IntrepGetNumArray(objP);
+
+        if (srcP->type == type)
+            return TCL_OK;
+        arrP = NumArrayAlloc(type, srcP->count);
+        if (Tclh_NativeArrayConvert(interp,
+                                    type,
+                                    arrP->values,
+                                    srcP->type,
+                                    srcP->values,
+                                    srcP->count,
+                                    1,
+                                    NULL)
+            != TCL_OK) {
+            Tcl_Free((char *)arrP);
+            return TCL_ERROR;
+        }
+        /* The string must stay the same irrespective of new native type */
+        (void) Tcl_GetString(objP);
+        NumArrayObjSetIntrep(objP, arrP);
+        return TCL_OK;
+    }
+
+    if (Tcl_ListObjGetElements(interp, objP, &count, &objs) != TCL_OK)
+        return TCL_ERROR;
+    arrP = NumArrayAlloc(type, count);
+    if (Tclh_ObjListToNativeArray(interp, type, objP, arrP->values, count, NULL)
+        != TCL_OK) {
+        Tcl_Free((char *)arrP);
+        return TCL_ERROR;
+    }
+
+    /*
+     * If the list has no string rep, we can skip generating one provided
+     * the one generated later from the native array would be identical.
+     * That is only the case if no element has a string rep of its own
+     * (which might be in a non-canonical form like 0x10) and every element
+     * already has an internal rep of the target kind so the conversion is
+     * not lossy. Float conversion is always potentially lossy.
+     */
+    needString = 0;
+    if (objP->bytes == NULL) {
+        if (type == TCLH_NATIVE_FLOAT)
+            needString = 1;
+        else {
+            for (i = 0; i < count; ++i) {
+                Tcl_WideInt wide;
+                if (objs[i]->bytes) {
+                    needString = 1;
+                    break;
+                }
+                if (type == TCLH_NATIVE_DOUBLE) {
+                    if (objs[i]->typePtr != gTclDoubleType) {
+                        needString = 1;
+                        break;
+                    }
+                } else if (!TclhObjIntrepToWide(objs[i], &wide)
+                           || (wide < 0 && !NumArrayTypeIsSigned(type))) {
+                    needString = 1;
+                    break;
+                }
+            }
+        }
+    }
+    if (needString)
+        (void) Tcl_GetString(objP);
+
+    /* Note objs[] is not valid beyond this point */
+    NumArrayObjSetIntrep(objP, arrP);
+    return TCL_OK;
+}
+
+Tcl_Obj *
+Tclh_NumArrayNewObj(Tclh_NativeType type, const void *valuesP, Tcl_Size count)
+{
+    Tcl_Obj *objP;
+    TclhNumArray *arrP;
+    size_t elemSize = Tclh_NativeTypeSize(type);
+
+    if (elemSize == 0)
+        return NULL;
+    if (count < 0)
+        count = 0;
+    arrP = NumArrayAlloc(type, count);
+    if (valuesP)
+        memcpy(arrP->values, valuesP, count * elemSize);
+    else
+        memset(arrP->values, 0, count * elemSize);
+
+    objP = Tcl_NewObj();
+    Tcl_InvalidateStringRep(objP);
+    NumArrayObjSetIntrep(objP, arrP);
+    return objP;
+}
+
+const void *
+Tclh_NumArrayGetRef(Tcl_Interp *interp,
+                    Tcl_Obj *objP,
+                    Tclh_NativeType type,
+                    Tcl_Size *countP)
+{
+    TclhNumArray *arrP;
+
+    if (Tclh_NativeTypeSize(type) == 0) {
+        Tclh_ErrorInvalidValueStr(
+            interp, NULL, "Invalid native type for numeric array.");
+        return NULL;
+    }
+    if (SetNumArrayObjFromAny(interp, objP, type) != TCL_OK)
+        return NULL;
+    arrP = IntrepGetNumArray(objP);
+    if (countP)
+        *countP = arrP->count;
+    return arrP->values;
+}
+
+void *
+Tclh_NumArrayGetWritable(Tcl_Interp *interp,
+                         Tcl_Obj *objP,
+                         Tclh_NativeType type,
+                         Tcl_Size *countP)
+{
+    TclhNumArray *arrP;
+
+    if (Tcl_IsShared(objP)) {
+        Tclh_ErrorGeneric(
+            interp, NULL, "Internal error: shared numeric array modified.");
+        return NULL;
+    }
+    if (Tclh_NumArrayGetRef(interp, objP, type, NULL) == NULL)
+        return NULL;
+    arrP = IntrepGetNumArray(objP);
+    if (arrP->nRefs > 1) {
+        /* Storage shared with duplicates. Need our own copy. */
+        TclhNumArray *newP = NumArrayAlloc(arrP->type, arrP->count);
+        memcpy(newP->values,
+               arrP->values,
+               arrP->count * Tclh_NativeTypeSize(arrP->type));
+        arrP->nRefs--;
+        newP->nRefs = 1;
+        IntrepSetNumArray(objP, newP);
+        arrP = newP;
+    }
+    Tcl_InvalidateStringRep(objP);
+    if (countP)
+        *countP = arrP->count;
+    return arrP->values;
+}
+
+Tcl_Obj *
+Tclh_NumArrayToList(Tcl_Interp *interp, Tcl_Obj *objP)
+{
+    TclhNumArray *arrP;
+    Tcl_Obj *listObj;
+
+    if (objP->typePtr != &gNumArrayVtbl) {
+        Tclh_ErrorWrongType(interp, objP, "Not a numeric array.");
+        return NULL;
+    }
+    arrP = IntrepGetNumArray(objP);
+    listObj =
+        Tclh_ObjListFromNativeArray(arrP->type, arrP->values, arrP->count);
+    if (listObj == NULL) {
+        Tclh_ErrorGeneric(
+            interp, "LIMIT", "Numeric array too large to convert to a list.");
+    }
+    return listObj;
+}
+
+/* Stores the range of an integer native type. Returns 0 for real types. */
+static int
+TclhNativeIntRange(Tclh_NativeType type,
+                   long long *lowP,
+                   unsigned long long *highP)
+{
+    switch (type) {
+    case TCLH_NATIVE_SCHAR: *lowP = SCHAR_MIN; *highP = SCHAR_MAX; return 1;
+    case TCLH_NATIVE_UCHAR: *lowP = 0; *highP = UCHAR_MAX; return 1;
+    case TCLH_NATIVE_SHORT: *lowP = SHRT_MIN; *highP = SHRT_MAX; return 1;
+    case TCLH_NATIVE_USHORT: *lowP = 0; *highP = USHRT_MAX; return 1;
+    case TCLH_NATIVE_INT: *lowP = INT_MIN; *highP = INT_MAX; return 1;
+    case TCLH_NATIVE_UINT: *lowP = 0; *highP = UINT_MAX; return 1;
+    case TCLH_NATIVE_LONG: *lowP = LONG_MIN; *highP = LONG_MAX; return 1;
+    case TCLH_NATIVE_ULONG: *lowP = 0; *highP = ULONG_MAX; return 1;
+    case TCLH_NATIVE_LONGLONG: *lowP = LLONG_MIN; *highP = LLONG_MAX; return 1;
+    case TCLH_NATIVE_ULONGLONG: *lowP = 0; *highP = ULLONG_MAX; return 1;
+    default: return 0;
+    }
+}
+
+/*
+ * Returns the index of the first element in srcP that cannot be converted
+ * to dstType without loss, or -1 if all are in range. The check is done
+ * in blocks with a branch-free inner loop so the common case of all values
+ * being in range can be vectorized. The block is rescanned to locate the
+ * offending element only if it contains one.
+ */
+static Tcl_Size
+TclhNativeArrayFindOutOfRange(Tclh_NativeType dstType,
+                              Tclh_NativeType srcType,
+                              const void *srcP,
+                              Tcl_Size count)
+{
+#define TCLH_RANGE_BLOCK 256
+    long long low;
+    unsigned long long high;
+    double dlow, dhigh;
+
+#define TCLH_FIND_BAD(stype_, badExpr_)                                       \
+    do {                                                                      \
+        const stype_ *s_ = (const stype_ *)srcP;                              \
+        Tcl_Size base_, j_, n_;                                               \
+        for (base_ = 0; base_ < count; base_ += TCLH_RANGE_BLOCK) {           \
+            int bad_ = 0;                                                     \
+            n_       = count - base_;                                         \
+            if (n_ > TCLH_RANGE_BLOCK)                                        \
+                n_ = TCLH_RANGE_BLOCK;                                        \
+            for (j_ = 0; j_ < n_; ++j_) {                                     \
+                stype_ v_ = s_[base_ + j_];                                   \
+                bad_ |= (badExpr_);                                           \
+            }                                                                 \
+            if (bad_) {                                                       \
+                for (j_ = 0; j_ < n_; ++j_) {                                 \
+                    stype_ v_ = s_[base_ + j_];                               \
+                    if (badExpr_)                                             \
+                        return base_ + j_;                                    \
+                }                                                             \
+            }                                                                 \
+        }                                                                     \
+    } while (0)
+#define TCLH_FIND_BAD_SIGNED(stype_)                                          \
+    TCLH_FIND_BAD(stype_,                                                     \
+                  (long long)v_ < low                                         \
+                      || (v_ > 0 && (unsigned long long)v_ > high))
+#define TCLH_FIND_BAD_UNSIGNED(stype_)                                        \
+    TCLH_FIND_BAD(stype_, (unsigned long long)v_ > high)
+    /* Note NaN fails the first comparison */
+#define TCLH_FIND_BAD_REAL(stype_)                                            \
+    TCLH_FIND_BAD(stype_,                                                     \
+                  !((double)v_ >= dlow && (double)v_ < dhigh)                 \
+                      || (double)v_ != floor((double)v_))
+
+    if (TclhNativeIntRange(dstType, &low, &high)) {
+        switch (srcType) {
+        case TCLH_NATIVE_SCHAR: TCLH_FIND_BAD_SIGNED(signed char); break;
+        case TCLH_NATIVE_UCHAR: TCLH_FIND_BAD_UNSIGNED(unsigned char); break;
+        case TCLH_NATIVE_SHORT: TCLH_FIND_BAD_SIGNED(short); break;
+        case TCLH_NATIVE_USHORT: TCLH_FIND_BAD_UNSIGNED(unsigned short); break;
+        case TCLH_NATIVE_INT: TCLH_FIND_BAD_SIGNED(int); break;
+        case TCLH_NATIVE_UINT: TCLH_FIND_BAD_UNSIGNED(unsigned int); break;
+        case TCLH_NATIVE_LONG: TCLH_FIND_BAD_SIGNED(long); break;
+        case TCLH_NATIVE_ULONG: TCLH_FIND_BAD_UNSIGNED(unsigned long); break;
+        case TCLH_NATIVE_LONGLONG: TCLH_FIND_BAD_SIGNED(long long); break;
+        case TCLH_NATIVE_ULONGLONG:
+            TCLH_FIND_BAD_UNSIGNED(unsigned long long);
+            break;
+        case TCLH_NATIVE_FLOAT:
+        case TCLH_NATIVE_DOUBLE:
+            /*
+             * Both limits are exactly representable as doubles. The upper
+             * one is exclusive, computed so as not to be rounded.
+             */
+            dlow  = (double)low;
+            dhigh = 2.0 * (double)((high >> 1) + 1);
+            if (srcType == TCLH_NATIVE_FLOAT)
+                TCLH_FIND_BAD_REAL(float);
+            else
+                TCLH_FIND_BAD_REAL(double);
+            break;
+        }
+    }
+    else if (dstType == TCLH_NATIVE_FLOAT && srcType == TCLH_NATIVE_DOUBLE) {
+        /* Finite values that overflow a float. Infinities are permitted. */
+        TCLH_FIND_BAD(double,
+                      (v_ > FLT_MAX && v_ <= DBL_MAX)
+                          || (v_ < -FLT_MAX && v_ >= -DBL_MAX));
+    }
+    /* All other conversions to float or double are always in range */
+    return -1;
+
+#undef TCLH_FIND_BAD
+#undef TCLH_FIND_BAD_SIGNED
+#undef TCLH_FIND_BAD_UNSIGNED
+#undef TCLH_FIND_BAD_REAL
+}
+
+Tclh_ReturnCode
+Tclh_NativeArrayConvert(Tcl_Interp *interp,
+                        Tclh_NativeType dstType,
+                        void *dstP,
+                        Tclh_NativeType srcType,
+                        const void *srcP,
+                        Tcl_Size count,
+                        Tclh_Bool checkRange,
+                        Tcl_Size *badIndexP)
+{
+    Tcl_Size i;
+    long long low;
+    unsigned long long high;
+    double dlow, dhigh;
+
+    if (Tclh_NativeTypeSize(dstType) == 0 || Tclh_NativeTypeSize(srcType) == 0) {
+        return Tclh_ErrorInvalidValueStr(
+            interp, NULL, "Invalid native type for array conversion.");
+    }
+    if (count <= 0)
+        return TCL_OK;
+    if (dstType == srcType) {
+        memmove(dstP, srcP, count * Tclh_NativeTypeSize(srcType));
+        return TCL_OK;
+    }
+
+    if (checkRange) {
+        Tcl_Size bad =
+            TclhNativeArrayFindOutOfRange(dstType, srcType, srcP, count);
+        if (bad >= 0) {
+            char buf[100];
+            if (badIndexP)
+                *badIndexP = bad;
+            snprintf(buf,
+                     sizeof(buf),
+                     "Value at index %" TCL_LL_MODIFIER
+                     "d is out of range for the target type.",
+                     (Tcl_WideInt)bad);
+            return Tclh_ErrorGeneric(interp, "RANGE", buf);
+        }
+    }
+
+    /*
+     * Plain casting loops. Type dispatch is done once outside the loop.
+     */
+#define TCLH_CONVERT_LOOP(dtype_, stype_)                                     \
+    do {                                                                      \
+        dtype_ *d_       = (dtype_ *)dstP;                                    \
+        const stype_ *s_ = (const stype_ *)srcP;                              \
+        for (i = 0; i < count; ++i)                                           \
+            d_[i] = (dtype_)s_[i];                                            \
+    } while (0)
+#define TCLH_CONVERT_FROM(stype_)                                             \
+    do {                                                                      \
+        switch (dstType) {                                                    \
+        case TCLH_NATIVE_SCHAR: TCLH_CONVERT_LOOP(signed char, stype_); break; \
+        case TCLH_NATIVE_UCHAR: TCLH_CONVERT_LOOP(unsigned char, stype_); break; \
+        case TCLH_NATIVE_SHORT: TCLH_CONVERT_LOOP(short, stype_); break;      \
+        case TCLH_NATIVE_USHORT: TCLH_CONVERT_LOOP(unsigned short, stype_); break; \
+        case TCLH_NATIVE_INT: TCLH_CONVERT_LOOP(int, stype_); break;          \
+        case TCLH_NATIVE_UINT: TCLH_CONVERT_LOOP(unsigned int, stype_); break; \
+        case TCLH_NATIVE_LONG: TCLH_CONVERT_LOOP(long, stype_); break;        \
+        case TCLH_NATIVE_ULONG: TCLH_CONVERT_LOOP(unsigned long, stype_); break; \
+        case TCLH_NATIVE_LONGLONG: TCLH_CONVERT_LOOP(long long, stype_); break; \
+        case TCLH_NATIVE_ULONGLONG:                                           \
+            TCLH_CONVERT_LOOP(unsigned long long, stype_);                    \
+            break;                                                            \
+        case TCLH_NATIVE_FLOAT: TCLH_CONVERT_LOOP(float, stype_); break;      \
+        case TCLH_NATIVE_DOUBLE: TCLH_CONVERT_LOOP(double, stype_); break;    \
+        }                                                                     \
+    } while (0)
+
+    /*
+     * Casting NaN or an out of range floating point value to an integer
+     * type, or a finite double beyond the float range to a float, is
+     * undefined behaviour in C. Unless already range checked, these
+     * conversions saturate instead. NaN is converted to 0.
+     */
+#define TCLH_SATURATE_LOOP(dtype_, stype_)                                    \
+    do {                                                                      \
+        dtype_ *d_       = (dtype_ *)dstP;                                    \
+        const stype_ *s_ = (const stype_ *)srcP;                              \
+        for (i = 0; i < count; ++i) {                                         \
+            double v_ = (double)s_[i];                                        \
+            d_[i] = v_ >= dlow ? (v_ < dhigh ? (dtype_)v_ : (dtype_)high)     \
+                               : (v_ < dlow ? (dtype_)low : (dtype_)0);       \
+        }                                                                     \
+    } while (0)
+#define TCLH_SATURATE_FROM(stype_)                                            \
+    do {                                                                      \
+        switch (dstType) {                                                    \
+        case TCLH_NATIVE_SCHAR: TCLH_SATURATE_LOOP(signed char, stype_); break; \
+        case TCLH_NATIVE_UCHAR: TCLH_SATURATE_LOOP(unsigned char, stype_); break; \
+        case TCLH_NATIVE_SHORT: TCLH_SATURATE_LOOP(short, stype_); break;     \
+        case TCLH_NATIVE_USHORT: TCLH_SATURATE_LOOP(unsigned short, stype_); break; \
+        case TCLH_NATIVE_INT: TCLH_SATURATE_LOOP(int, stype_); break;         \
+        case TCLH_NATIVE_UINT: TCLH_SATURATE_LOOP(unsigned int, stype_); break; \
+        case TCLH_NATIVE_LONG: TCLH_SATURATE_LOOP(long, stype_); break;       \
+        case TCLH_NATIVE_ULONG: TCLH_SATURATE_LOOP(unsigned long, stype_); break; \
+        case TCLH_NATIVE_LONGLONG: TCLH_SATURATE_LOOP(long long, stype_); break; \
+        case TCLH_NATIVE_ULONGLONG:                                           \
+            TCLH_SATURATE_LOOP(unsigned long long, stype_);                   \
+            break;                                                            \
+        default: break;                                                       \
+        }                                                                     \
+    } while (0)
+
+    if (!checkRange
+        && (srcType == TCLH_NATIVE_FLOAT || srcType == TCLH_NATIVE_DOUBLE)
+        && TclhNativeIntRange(dstType, &low, &high)) {
+        /* Same limits as TclhNativeArrayFindOutOfRange */
+        dlow  = (double)low;
+        dhigh = 2.0 * (double)((high >> 1) + 1);
+        if (srcType == TCLH_NATIVE_FLOAT)
+            TCLH_SATURATE_FROM(float);
+        else
+            TCLH_SATURATE_FROM(double);
+        return TCL_OK;
+    }
+    if (!checkRange && dstType == TCLH_NATIVE_FLOAT
+        && srcType == TCLH_NATIVE_DOUBLE) {
+        float *d_       = (float *)dstP;
+        const double *s_ = (const double *)srcP;
+        for (i = 0; i < count; ++i) {
+            double v_ = s_[i];
+            d_[i] = v_ > FLT_MAX    ? HUGE_VALF
+                    : v_ < -FLT_MAX ? -HUGE_VALF
+                                    : (float)v_;
+        }
+        return TCL_OK;
+    }
+
+#undef TCLH_SATURATE_LOOP
+#undef TCLH_SATURATE_FROM
+
+    switch (srcType) {
+    case TCLH_NATIVE_SCHAR: TCLH_CONVERT_FROM(signed char); break;
+    case TCLH_NATIVE_UCHAR: TCLH_CONVERT_FROM(unsigned char); break;
+    case TCLH_NATIVE_SHORT: TCLH_CONVERT_FROM(short); break;
+    case TCLH_NATIVE_USHORT: TCLH_CONVERT_FROM(unsigned short); break;
+    case TCLH_NATIVE_INT: TCLH_CONVERT_FROM(int); break;
+    case TCLH_NATIVE_UINT: TCLH_CONVERT_FROM(unsigned int); break;
+    case TCLH_NATIVE_LONG: TCLH_CONVERT_FROM(long); break;
+    case TCLH_NATIVE_ULONG: TCLH_CONVERT_FROM(unsigned long); break;
+    case TCLH_NATIVE_LONGLONG: TCLH_CONVERT_FROM(long long); break;
+    case TCLH_NATIVE_ULONGLONG: TCLH_CONVERT_FROM(unsigned long long); break;
+    case TCLH_NATIVE_FLOAT: TCLH_CONVERT_FROM(float); break;
+    case TCLH_NATIVE_DOUBLE: TCLH_CONVERT_FROM(double); break;
+    }
+
+#undef TCLH_CONVERT_LOOP
+#undef TCLH_CONVERT_FROM
+
+    return TCL_OK;
+}
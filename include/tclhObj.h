@@ -92,6 +92,76 @@ TCLH_INLINE void Tclh_FreeIfNoRefs(Tcl_Obj *objP) {
 #endif
 }
 
+/*
+ * Section: Shared constant Tcl_Obj values
+ *
+ * Small integers, booleans and the empty string may be obtained from a
+ * per-thread cache of Tcl_Obj values instead of being allocated on every
+ * call. The cached range may be configured by defining TCLH_OBJ_SMALLINT_MIN
+ * and TCLH_OBJ_SMALLINT_MAX before including the header. Defining the latter
+ * to be less than the former disables caching of integers.
+ *
+ * The cache is only used by callers that opt in through the functions in
+ * this section. The *Tclh_ObjFrom* functions for integer types always
+ * return a new Tcl_Obj with a zero reference count.
+ *
+ * Because the returned Tcl_Obj values may be shared, callers must never
+ * modify them in place. They must be treated like any Tcl_Obj with a
+ * reference count greater than zero, i.e. Tcl_IncrRefCount before storing
+ * and Tcl_DecrRefCount when done, or passed directly to a Tcl API that
+ * takes ownership.
+ */
+#ifndef TCLH_OBJ_SMALLINT_MIN
+# define TCLH_OBJ_SMALLINT_MIN -1
+#endif
+#ifndef TCLH_OBJ_SMALLINT_MAX
+# define TCLH_OBJ_SMALLINT_MAX 255
+#endif
+
+/* Function: Tclh_ObjSharedInt
+ * Returns a possibly shared Tcl_Obj for an integer.
+ *
+ * Parameters:
+ * val - value to be wrapped
+ *
+ * Values in the range TCLH_OBJ_SMALLINT_MIN to TCLH_OBJ_SMALLINT_MAX are
+ * returned from the cache. Others are returned as a new Tcl_Obj.
+ *
+ * Returns:
+ * A Tcl_Obj that must not be modified. The reference count is not
+ * necessarily zero.
+ */
+TCLH_LOCAL Tcl_Obj *Tclh_ObjSharedInt(Tcl_WideInt val);
+
+/* Function: Tclh_ObjFromBool
+ * Returns a shared Tcl_Obj holding a boolean value.
+ *
+ * Parameters:
+ * val - boolean value. Any non-0 value is treated as true.
+ *
+ * Returns:
+ * A Tcl_Obj with the value 0 or 1 that must not be modified.
+ */
+TCLH_LOCAL Tcl_Obj *Tclh_ObjFromBool(int val);
+
+/* Function: Tclh_ObjEmpty
+ * Returns a shared empty Tcl_Obj.
+ *
+ * Returns:
+ * A Tcl_Obj holding the empty string that must not be modified.
+ */
+TCLH_LOCAL Tcl_Obj *Tclh_ObjEmpty(void);
+
+/* Macro: TCLH_OBJ_IS_SMALLINT
+ * Evaluates to true if the argument is within the shared small integer range.
+ */
+#if TCLH_OBJ_SMALLINT_MAX >= TCLH_OBJ_SMALLINT_MIN
+# define TCLH_OBJ_IS_SMALLINT(val_)          \
+    ((val_) >= TCLH_OBJ_SMALLINT_MIN && (val_) <= TCLH_OBJ_SMALLINT_MAX)
+#else
+# define TCLH_OBJ_IS_SMALLINT(val_) 0
+#endif
+
 /* Function: Tclh_ObjToRangedInt
  * Unwraps a Tcl_Obj into a Tcl_WideInt if it is within a specified range.
  *
@@ -389,6 +459,24 @@ Tclh_ObjToULongLong(Tcl_Interp *interp, Tcl_Obj *obj, unsigned long long *ptr);
  */
 TCLH_LOCAL Tcl_Obj *Tclh_ObjFromULongLong(unsigned long long ull);
 
+/* Function: Tclh_ObjSharedULongLong
+ * Returns a possibly shared Tcl_Obj for an *unsigned long long*.
+ *
+ * Parameters:
+ *  ull - value to be wrapped
+ *
+ * As for <Tclh_ObjSharedInt> but for unsigned values.
+ *
+ * Returns:
+ * A Tcl_Obj that must not be modified. The reference count is not
+ * necessarily zero.
+ */
+TCLH_INLINE Tcl_Obj *Tclh_ObjSharedULongLong(unsigned long long ull) {
+    if (ull <= LLONG_MAX)
+        return Tclh_ObjSharedInt((Tcl_WideInt)ull);
+    return Tclh_ObjFromULongLong(ull);
+}
+
 
 /* Function: Tclh_ObjToFloat
  * Unwraps a Tcl_Obj into a C *float* value type.
@@ -424,6 +512,181 @@ TCLH_LOCAL Tclh_ReturnCode Tclh_ObjToDouble(Tcl_Interp *interp,
                                             Tcl_Obj *obj,
                                             double *ptr);
 
+/* Typedef: Tclh_NativeType
+ * Identifies a C numeric type for the bulk array conversion functions.
+ */
+typedef enum Tclh_NativeType {
+    TCLH_NATIVE_SCHAR,     /* signed char */
+    TCLH_NATIVE_UCHAR,     /* unsigned char */
+    TCLH_NATIVE_SHORT,     /* short */
+    TCLH_NATIVE_USHORT,    /* unsigned short */
+    TCLH_NATIVE_INT,       /* int */
+    TCLH_NATIVE_UINT,      /* unsigned int */
+    TCLH_NATIVE_LONG,      /* long */
+    TCLH_NATIVE_ULONG,     /* unsigned long */
+    TCLH_NATIVE_LONGLONG,  /* long long (same as Tcl_WideInt) */
+    TCLH_NATIVE_ULONGLONG, /* unsigned long long */
+    TCLH_NATIVE_FLOAT,     /* float */
+    TCLH_NATIVE_DOUBLE,    /* double */
+} Tclh_NativeType;
+
+/* Function: Tclh_NativeTypeSize
+ * Returns the size of a native type.
+ *
+ * Parameters:
+ * type - a <Tclh_NativeType> value
+ *
+ * Returns:
+ * Size of the corresponding C type or 0 if *type* is not valid.
+ */
+TCLH_INLINE size_t Tclh_NativeTypeSize(Tclh_NativeType type) {
+    switch (type) {
+    case TCLH_NATIVE_SCHAR: return sizeof(signed char);
+    case TCLH_NATIVE_UCHAR: return sizeof(unsigned char);
+    case TCLH_NATIVE_SHORT: return sizeof(short);
+    case TCLH_NATIVE_USHORT: return sizeof(unsigned short);
+    case TCLH_NATIVE_INT: return sizeof(int);
+    case TCLH_NATIVE_UINT: return sizeof(unsigned int);
+    case TCLH_NATIVE_LONG: return sizeof(long);
+    case TCLH_NATIVE_ULONG: return sizeof(unsigned long);
+    case TCLH_NATIVE_LONGLONG: return sizeof(long long);
+    case TCLH_NATIVE_ULONGLONG: return sizeof(unsigned long long);
+    case TCLH_NATIVE_FLOAT: return sizeof(float);
+    case TCLH_NATIVE_DOUBLE: return sizeof(double);
+    }
+    return 0;
+}
+
+/* Function: Tclh_ObjListToNativeArray
+ * Converts a Tcl list of numbers to a C array of a numeric type.
+ *
+ * Parameters:
+ * interp - Interpreter for error messages. May be NULL.
+ * type - the <Tclh_NativeType> of the array elements
+ * listObj - Tcl_Obj containing the list of numbers
+ * dstP - pointer to the array to be filled
+ * dstCount - capacity of the array in number of elements
+ * numElemsP - location to store the number of elements stored. May be NULL.
+ *
+ * This is equivalent to calling the *Tclh_ObjTo** function corresponding
+ * to *type* for each element of the list but is considerably faster for
+ * large lists. Elements that already have an integer or floating point
+ * internal representation are converted without going through the
+ * overflow checks required for strings. Range checks for the target type
+ * are still applied to every element.
+ *
+ * Returns:
+ * TCL_OK on success with the values stored in *dstP*. On error, TCL_ERROR
+ * with an error message in the interpreter. The content of *dstP* is
+ * undefined in that case.
+ */
+TCLH_LOCAL Tclh_ReturnCode Tclh_ObjListToNativeArray(Tcl_Interp *interp,
+                                                     Tclh_NativeType type,
+                                                     Tcl_Obj *listObj,
+                                                     void *dstP,
+                                                     Tcl_Size dstCount,
+                                                     Tcl_Size *numElemsP);
+
+/* Function: Tclh_ObjListFromNativeArray
+ * Returns a Tcl list containing the values in a C array of a numeric type.
+ *
+ * Parameters:
+ * type - the <Tclh_NativeType> of the array elements
+ * srcP - pointer to the array
+ * count - number of elements in the array
+ *
+ * The list is allocated with exactly the required capacity and all element
+ * objects are created in a single pass. Elements with the same small
+ * integer value share a single Tcl_Obj.
+ *
+ * Returns:
+ * A pointer to a Tcl_Obj list with a zero reference count or NULL if
+ * *type* is not a valid <Tclh_NativeType> or *count* exceeds the
+ * maximum size of a list.
+ */
+TCLH_LOCAL Tcl_Obj *Tclh_ObjListFromNativeArray(Tclh_NativeType type,
+                                                const void *srcP,
+                                                Tcl_Size count);
+
+#ifdef TCLH_LIFO_E_SUCCESS /* Only define if Lifo module is available */
+/* Function: Tclh_ObjListToNativeArrayLifo
+ * Converts a Tcl list of numbers to a C array allocated from a Tclh_Lifo.
+ *
+ * Parameters:
+ * interp - Interpreter for error messages. May be NULL.
+ * type - the <Tclh_NativeType> of the array elements
+ * listObj - Tcl_Obj containing the list of numbers
+ * lifoP - the Tclh_Lifo from which to allocate the array
+ * arrayPP - location to store pointer to the allocated array
+ * numElemsP - location to store the number of elements in the array.
+ *    May be NULL.
+ *
+ * See <Tclh_ObjListToNativeArray> for details of the conversion.
+ * The *tclhLifo.h* file must be included before *tclhObj.h*
+ * for this function to be present.
+ *
+ * Returns:
+ * TCL_OK on success, else TCL_ERROR with an error message in the
+ * interpreter.
+ */
+TCLH_LOCAL Tclh_ReturnCode Tclh_ObjListToNativeArrayLifo(Tcl_Interp *interp,
+                                                         Tclh_NativeType type,
+                                                         Tcl_Obj *listObj,
+                                                         Tclh_Lifo *lifoP,
+                                                         void **arrayPP,
+                                                         Tcl_Size *numElemsP);
+#endif
+
+/* Function: Tclh_ObjFromMappedFile
+ * Returns a Tcl_Obj whose bytes are a memory mapped view of a file.
+ *
+ * Parameters:
+ * interp - Interpreter for error messages. May be NULL.
+ * pathObj - path of the file to map. As for the Tcl filesystem functions,
+ *    the caller should hold a reference to it.
+ * objPP - location to store the Tcl_Obj. This will have a zero reference
+ *    count.
+ *
+ * Only regular files can be mapped. Devices, FIFOs and directories are
+ * rejected with an error.
+ *
+ * The file is opened read-only and mapped with private copy-on-write pages
+ * so it is never modified through the returned Tcl_Obj. The content is
+ * accessible without copying through <Tclh_ObjGetBytesReadOnly>. Writers
+ * must go through <Tclh_ObjGetBytesWritable>. Duplicates of the Tcl_Obj share
+ * the same mapping which is unmapped when the last of them is freed or
+ * converted to another type. Changes to the file while it is mapped may
+ * or may not be reflected in the Tcl_Obj depending on the platform.
+ *
+ * The string representation is generated as for a binary byte array if
+ * demanded by the script level. Use of the Tcl_Obj as a byte array by Tcl
+ * itself, for example when modified by a script, converts it to a regular
+ * byte array copy of the data.
+ *
+ * Returns:
+ * TCL_OK on success, TCL_ERROR with an error message in the interpreter.
+ */
+TCLH_LOCAL Tclh_ReturnCode Tclh_ObjFromMappedFile(Tcl_Interp *interp,
+                                                  Tcl_Obj *pathObj,
+                                                  Tcl_Obj **objPP);
+
+/* Function: Tclh_ObjGetMappedBytes
+ * Retrieves a reference to the bytes in a Tcl_Obj created with
+ * <Tclh_ObjFromMappedFile>.
+ *
+ * Parameters:
+ * obj - Tcl_Obj containing the bytes
+ * lenPtr - location to store number of bytes. May be NULL.
+ *
+ * Applications will generally call <Tclh_ObjGetBytesReadOnly> instead which
+ * works with both mapped files and byte arrays.
+ *
+ * Returns:
+ * Pointer to the mapped bytes or NULL if the Tcl_Obj does not hold a
+ * mapped file.
+ */
+TCLH_LOCAL char *Tclh_ObjGetMappedBytes(Tcl_Obj *obj, Tcl_Size *lenPtr);
+
 /* Function: Tclh_ObjGetBytesByRef
  * Retrieves a reference to the byte array in a Tcl_Obj.
  *
@@ -434,6 +697,10 @@ TCLH_LOCAL Tclh_ReturnCode Tclh_ObjToDouble(Tcl_Interp *interp,
  * obj - Tcl_Obj containing the bytes
  * lenPtr - location to store number of bytes in the array. May be NULL.
  *
+ * A Tcl_Obj created with <Tclh_ObjFromMappedFile> is converted to a
+ * regular byte array so the returned storage is never shared with a
+ * mapping. Use <Tclh_ObjGetBytesReadOnly> to access it without copying.
+ *
  * Returns:
  * On success, returns a pointer to internal byte array and stores the
  * length of the array in lenPtr if not NULL. On error, returns
@@ -449,6 +716,54 @@ Tclh_ObjGetBytesByRef(Tcl_Interp *interp, Tcl_Obj *obj, Tcl_Size *lenPtr)
 #endif
 }
 
+/* Function: Tclh_ObjGetBytesReadOnly
+ * Retrieves a read-only reference to the bytes in a Tcl_Obj.
+ *
+ * Parameters:
+ * interp - Interpreter for error messages. May be NULL.
+ * obj - Tcl_Obj containing the bytes
+ * lenPtr - location to store number of bytes in the array. May be NULL.
+ *
+ * As for <Tclh_ObjGetBytesByRef> except that Tcl_Obj values created with
+ * <Tclh_ObjFromMappedFile> are accessed without copying. As the mapping
+ * may be shared with duplicates of *obj*, the returned bytes must not be
+ * modified. See <Tclh_ObjGetBytesWritable>.
+ *
+ * Returns:
+ * On success, returns a pointer to the bytes and stores their number in
+ * lenPtr if not NULL. On error, returns a NULL pointer with an error
+ * message in the interpreter.
+ */
+TCLH_INLINE const char *
+Tclh_ObjGetBytesReadOnly(Tcl_Interp *interp, Tcl_Obj *obj, Tcl_Size *lenPtr)
+{
+    const char *bytes = Tclh_ObjGetMappedBytes(obj, lenPtr);
+    if (bytes)
+        return bytes;
+    return Tclh_ObjGetBytesByRef(interp, obj, lenPtr);
+}
+
+/* Function: Tclh_ObjGetBytesWritable
+ * Retrieves a reference to the byte array in a Tcl_Obj for modification.
+ *
+ * Parameters:
+ * interp - Interpreter for error messages. May be NULL.
+ * obj - Tcl_Obj containing the bytes. Must not be shared.
+ * lenPtr - location to store number of bytes in the array. May be NULL.
+ *
+ * The string representation of *obj* is invalidated. For a Tcl_Obj created
+ * with <Tclh_ObjFromMappedFile>, modified pages are private copies and the
+ * file itself is not modified. If the mapping is shared with duplicates of
+ * *obj*, the data is first copied into a regular byte array.
+ *
+ * Returns:
+ * On success, returns a pointer to internal byte array and stores the
+ * length of the array in lenPtr if not NULL. On error, returns
+ * a NULL pointer with an error message in the interpreter.
+ */
+TCLH_LOCAL char *
+Tclh_ObjGetBytesWritable(Tcl_Interp *interp, Tcl_Obj *obj, Tcl_Size *lenPtr);
+
 /* Function: Tclh_ObjFromAddress
  * Wraps a memory address into a Tcl_Obj.
  *
@@ -546,7 +861,21 @@ TCLH_INLINE Tcl_Obj* Tclh_ObjFromDString(Tcl_DString *dsP) {
 #define ObjFromAddress Tclh_ObjFromAddress
 #define ObjToAddress Tclh_ObjToAddress
 #define ObjGetBytesByRef Tclh_ObjGetBytesByRef
+#define ObjGetBytesReadOnly Tclh_ObjGetBytesReadOnly
+#define ObjGetBytesWritable Tclh_ObjGetBytesWritable
+#define ObjFromMappedFile Tclh_ObjFromMappedFile
+#define ObjGetMappedBytes Tclh_ObjGetMappedBytes
 #define ObjFromDString Tclh_ObjFromDString
+#define ObjSharedInt Tclh_ObjSharedInt
+#define ObjSharedULongLong Tclh_ObjSharedULongLong
+#define ObjFromBool Tclh_ObjFromBool
+#define ObjEmpty Tclh_ObjEmpty
+#define NativeTypeSize Tclh_NativeTypeSize
+#define ObjListToNativeArray Tclh_ObjListToNativeArray
+#define ObjListFromNativeArray Tclh_ObjListFromNativeArray
+#ifdef TCLH_LIFO_E_SUCCESS
+#define ObjListToNativeArrayLifo Tclh_ObjListToNativeArrayLifo
+#endif
 #endif
 
 #ifdef TCLH_IMPL
@@ -6,6 +6,13 @@
  */
 
 #include "tclhObj.h"
+#include <float.h>
+#ifndef _WIN32
+# include <sys/mman.h>
+# include <sys/stat.h>
+# include <fcntl.h>
+# include <unistd.h>
+#endif
 
 static const Tcl_ObjType *gTclIntType;
 static const Tcl_ObjType *gTclWideIntType;
@@ -89,6 +96,98 @@ Tclh_GetObjTypeDescriptor(const char *typename)
     return Tcl_GetObjType(typename);
 }
 
+/*
+ * Per-thread cache of shared Tcl_Obj constants. Tcl_Obj values cannot be
+ * shared across threads so the cache cannot be process-wide.
+ */
+typedef struct TclhObjSharedCache {
+    int initialized;
+    Tcl_Obj *emptyObj;
+    Tcl_Obj *boolObjs[2];
+#if TCLH_OBJ_SMALLINT_MAX >= TCLH_OBJ_SMALLINT_MIN
+    Tcl_Obj *smallInts[TCLH_OBJ_SMALLINT_MAX - TCLH_OBJ_SMALLINT_MIN + 1];
+#endif
+} TclhObjSharedCache;
+static Tcl_ThreadDataKey gTclhObjSharedCacheKey;
+
+static void
+TclhObjSharedCacheFree(ClientData clientData)
+{
+    TclhObjSharedCache *cacheP = (TclhObjSharedCache *)clientData;
+    Tclh_ObjClearPtr(&cacheP->emptyObj);
+    Tclh_ObjClearPtr(&cacheP->boolObjs[0]);
+    Tclh_ObjClearPtr(&cacheP->boolObjs[1]);
+#if TCLH_OBJ_SMALLINT_MAX >= TCLH_OBJ_SMALLINT_MIN
+    {
+        int i;
+        for (i = 0; i < TCLH_OBJ_SMALLINT_MAX - TCLH_OBJ_SMALLINT_MIN + 1; ++i)
+            Tclh_ObjClearPtr(&cacheP->smallInts[i]);
+    }
+#endif
+    cacheP->initialized = 0;
+}
+
+static TclhObjSharedCache *
+TclhObjGetSharedCache(void)
+{
+    /* Note Tcl_GetThreadData zeroes the block on first allocation */
+    TclhObjSharedCache *cacheP = (TclhObjSharedCache *)Tcl_GetThreadData(
+        &gTclhObjSharedCacheKey, sizeof(TclhObjSharedCache));
+    if (!cacheP->initialized) {
+        cacheP->initialized = 1;
+        Tcl_CreateThreadExitHandler(TclhObjSharedCacheFree, cacheP);
+    }
+    return cacheP;
+}
+
+/* Caller must ensure val is within TCLH_OBJ_SMALLINT_MIN:MAX range */
+TCLH_INLINE Tcl_Obj *
+TclhObjSharedIntFromCache(TclhObjSharedCache *cacheP, Tcl_WideInt val)
+{
+#if TCLH_OBJ_SMALLINT_MAX >= TCLH_OBJ_SMALLINT_MIN
+    Tcl_Obj **objPP = &cacheP->smallInts[val - TCLH_OBJ_SMALLINT_MIN];
+    if (*objPP == NULL) {
+        *objPP = Tcl_NewWideIntObj(val);
+        Tcl_IncrRefCount(*objPP);
+    }
+    return *objPP;
+#else
+    (void)cacheP;
+    return Tcl_NewWideIntObj(val);
+#endif
+}
+
+Tcl_Obj *
+Tclh_ObjSharedInt(Tcl_WideInt val)
+{
+    if (!TCLH_OBJ_IS_SMALLINT(val))
+        return Tcl_NewWideIntObj(val);
+    return TclhObjSharedIntFromCache(TclhObjGetSharedCache(), val);
+}
+
+Tcl_Obj *
+Tclh_ObjFromBool(int val)
+{
+    TclhObjSharedCache *cacheP = TclhObjGetSharedCache();
+    Tcl_Obj **objPP = &cacheP->boolObjs[val ? 1 : 0];
+    if (*objPP == NULL) {
+        *objPP = Tcl_NewBooleanObj(val);
+        Tcl_IncrRefCount(*objPP);
+    }
+    return *objPP;
+}
+
+Tcl_Obj *
+Tclh_ObjEmpty(void)
+{
+    TclhObjSharedCache *cacheP = TclhObjGetSharedCache();
+    if (cacheP->emptyObj == NULL) {
+        cacheP->emptyObj = Tcl_NewObj();
+        Tcl_IncrRefCount(cacheP->emptyObj);
+    }
+    return cacheP->emptyObj;
+}
+
 Tclh_ReturnCode
 Tclh_ObjToRangedInt(Tcl_Interp *interp,
                     Tcl_Obj *obj,
@@ -225,12 +324,118 @@ Tcl_Obj *Tclh_ObjFromULong(unsigned long ul)
         return Tclh_ObjFromULongLong(ul);
 }
 
+/*
+ * Parses the string representation of a pure string Tcl_Obj holding a
+ * decimal or hexadecimal (0x prefixed) integer with an optional sign. The
+ * magnitude is stored in *magP and the sign in *negP.
+ *
+ * Returns 1 on success. Returns 0 if the Tcl_Obj has an internal
+ * representation, or its string is not in one of the above strict forms
+ * (whitespace, other radix prefixes, leading zeroes whose interpretation
+ * differs between Tcl versions etc.), or the magnitude does not fit in 64
+ * bits. In all these cases the caller must fall back to Tcl's own parsing.
+ */
+static int
+TclhObjParseUInt64(Tcl_Obj *objP, Tcl_WideUInt *magP, int *negP)
+{
+    const char *p;
+    const char *end;
+    Tcl_WideUInt mag = 0;
+    int neg          = 0;
+
+    if (objP->typePtr != NULL || objP->bytes == NULL)
+        return 0;
+    p   = objP->bytes;
+    end = p + objP->length;
+    if (p == end)
+        return 0;
+    if (*p == '-' || *p == '+') {
+        neg = (*p == '-');
+        if (++p == end)
+            return 0;
+    }
+    if (*p == '0' && (end - p) > 1) {
+        if ((p[1] != 'x' && p[1] != 'X') || (end - p) == 2)
+            return 0;
+        for (p += 2; p < end; ++p) {
+            unsigned int digit;
+            unsigned char c = (unsigned char)*p;
+            if (c >= '0' && c <= '9')
+                digit = c - '0';
+            else if (c >= 'a' && c <= 'f')
+                digit = c - 'a' + 10;
+            else if (c >= 'A' && c <= 'F')
+                digit = c - 'A' + 10;
+            else
+                return 0;
+            if (mag >> 60)
+                return 0; /* Would overflow */
+            mag = (mag << 4) | digit;
+        }
+    }
+    else {
+        for (; p < end; ++p) {
+            unsigned int digit = (unsigned char)*p - '0';
+            if (digit > 9)
+                return 0;
+            if (mag > (~(Tcl_WideUInt)0 - digit) / 10)
+                return 0; /* Would overflow */
+            mag = mag * 10 + digit;
+        }
+    }
+    *magP = mag;
+    *negP = neg;
+    return 1;
+}
+
+/*
+ * Sets the internal representation of a pure string Tcl_Obj to the Tcl
+ * integer type that Tcl itself would use for the value. The string
+ * representation is retained.
+ */
+static void
+TclhObjSetIntIntrep(Tcl_Obj *objP, Tcl_WideInt wide)
+{
+    TCLH_ASSERT(objP->typePtr == NULL && objP->bytes != NULL);
+#ifdef TCLH_TCL87API
+    objP->internalRep.wideValue = wide;
+    objP->typePtr               = gTclIntType;
+#else
+    if (wide >= LONG_MIN && wide <= LONG_MAX) {
+        objP->internalRep.longValue = (long)wide;
+        objP->typePtr               = gTclIntType;
+    }
+    else {
+        objP->internalRep.wideValue = wide;
+        objP->typePtr               = gTclWideIntType;
+    }
+#endif
+}
+
 Tclh_ReturnCode
 Tclh_ObjToWideInt(Tcl_Interp *interp, Tcl_Obj *objP, Tcl_WideInt *wideP)
 {
     /* TODO - can we just use Tcl_GetWideIntFromObj in Tcl9? Does it error if > WIDE_MAX? */
     int ret;
+    int neg;
     Tcl_WideInt wide;
+    Tcl_WideUInt mag;
+
+    /*
+     * Numeric strings, e.g. freshly read from a file, are parsed directly
+     * avoiding the bignum check below. Values out of range are left to the
+     * full path to generate the error.
+     */
+    if (TclhObjParseUInt64(objP, &mag, &neg)) {
+        if (neg ? mag <= (Tcl_WideUInt)LLONG_MAX + 1
+                : mag <= (Tcl_WideUInt)LLONG_MAX) {
+            wide = neg ? (Tcl_WideInt)(0 - mag) : (Tcl_WideInt)mag;
+            TclhObjSetIntIntrep(objP, wide);
+            *wideP = wide;
+            return TCL_OK;
+        }
+    }
+
     ret = Tcl_GetWideIntFromObj(interp, objP, &wide);
     if (ret != TCL_OK)
         return ret;
@@ -277,6 +482,20 @@ Tclh_ReturnCode
 Tclh_ObjToULongLong(Tcl_Interp *interp, Tcl_Obj *objP, unsigned long long *ullP)
 {
     int ret;
+    int neg;
+    Tcl_WideUInt mag;
+
+    /*
+     * Fast path for numeric strings. See Tclh_ObjToWideInt. Negative values
+     * are left to the full path to generate the error.
+     */
+    if (TclhObjParseUInt64(objP, &mag, &neg) && (mag == 0 || !neg)) {
+        /* Values beyond LLONG_MAX need a bignum intrep. Leave as string. */
+        if (mag <= (Tcl_WideUInt)LLONG_MAX)
+            TclhObjSetIntIntrep(objP, (Tcl_WideInt)mag);
+        *ullP = mag;
+        return TCL_OK;
+    }
 
 #if TCLH_TCLAPI_VERSION >= 0x0807
     Tcl_WideUInt uwide;
@@ -371,16 +590,322 @@ Tclh_ObjToDouble(Tcl_Interp *interp, Tcl_Obj *objP, double *dblP)
     return Tcl_GetDoubleFromObj(interp, objP, dblP);
 }
 
+/*
+ * Returns 1 if a double can be narrowed to a float. Finite values beyond
+ * the float range cannot as the conversion is undefined behaviour.
+ * Infinities and NaN are permitted as for Tclh_NativeArrayConvert.
+ */
+TCLH_INLINE int
+TclhDoubleFitsFloat(double dval)
+{
+    return !((dval > FLT_MAX && dval <= DBL_MAX)
+             || (dval < -FLT_MAX && dval >= -DBL_MAX));
+}
+
 Tclh_ReturnCode
 Tclh_ObjToFloat(Tcl_Interp *interp, Tcl_Obj *objP, float *fltP)
 {
     double dval;
     if (Tcl_GetDoubleFromObj(interp, objP, &dval) != TCL_OK)
         return TCL_ERROR;
+    if (!TclhDoubleFitsFloat(dval)) {
+        return Tclh_ErrorInvalidValue(
+            interp, objP, "Value out of range for a float.");
+    }
     *fltP = (float) dval;
     return TCL_OK;
 }
 
+/*
+ * Retrieves the integer value of a Tcl_Obj directly from its internal
+ * representation if it is one of Tcl's integer types. Returns 1 on success
+ * and 0 if the value needs to go through the full conversion routines.
+ */
+TCLH_INLINE int
+TclhObjIntrepToWide(Tcl_Obj *objP, Tcl_WideInt *wideP)
+{
+    TCLH_ASSERT(gTclIntType);
+#ifdef TCLH_TCL87API
+    if (objP->typePtr == gTclIntType) {
+        *wideP = objP->internalRep.wideValue;
+        return 1;
+    }
+#else
+    if (objP->typePtr == gTclIntType) {
+        *wideP = objP->internalRep.longValue;
+        return 1;
+    }
+    if (objP->typePtr == gTclWideIntType) {
+        *wideP = objP->internalRep.wideValue;
+        return 1;
+    }
+#endif
+    return 0;
+}
+
+/*
+ * Converts an array of Tcl_Obj to an array of native values. The type
+ * dispatch is done once outside the loop and range limits are fixed for
+ * the whole array.
+ */
+static Tclh_ReturnCode
+TclhObjsToNativeArray(Tcl_Interp *interp,
+                      Tclh_NativeType type,
+                      Tcl_Size nobjs,
+                      Tcl_Obj *const objs[],
+                      void *dstP)
+{
+    Tcl_Size i;
+
+#define TCLH_OBJS_TO_INTS(ctype_, low_, high_)                                \
+    do {                                                                      \
+        ctype_ *p_ = (ctype_ *)dstP;                                          \
+        for (i = 0; i < nobjs; ++i) {                                         \
+            Tcl_WideInt wide_;                                                \
+            if (!TclhObjIntrepToWide(objs[i], &wide_)                         \
+                && Tclh_ObjToWideInt(interp, objs[i], &wide_) != TCL_OK)      \
+                return TCL_ERROR;                                             \
+            if (wide_ < (Tcl_WideInt)(low_) || wide_ > (Tcl_WideInt)(high_)) \
+                return Tclh_ErrorRange(interp, objs[i], low_, high_);         \
+            p_[i] = (ctype_)wide_;                                            \
+        }                                                                     \
+    } while (0)
+
+#define TCLH_OBJS_TO_UNSIGNED64(ctype_)                                       \
+    do {                                                                      \
+        ctype_ *p_ = (ctype_ *)dstP;                                          \
+        for (i = 0; i < nobjs; ++i) {                                         \
+            Tcl_WideInt wide_;                                                \
+            unsigned long long ull_;                                          \
+            if (TclhObjIntrepToWide(objs[i], &wide_) && wide_ >= 0)           \
+                ull_ = (unsigned long long)wide_;                             \
+            else if (Tclh_ObjToULongLong(interp, objs[i], &ull_) != TCL_OK)   \
+                return TCL_ERROR;                                             \
+            p_[i] = (ctype_)ull_;                                             \
+        }                                                                     \
+    } while (0)
+
+#define TCLH_OBJS_TO_REALS(ctype_)                                            \
+    do {                                                                      \
+        ctype_ *p_ = (ctype_ *)dstP;                                          \
+        for (i = 0; i < nobjs; ++i) {                                         \
+            double dbl_;                                                      \
+            Tcl_WideInt wide_;                                                \
+            if (objs[i]->typePtr == gTclDoubleType)                           \
+                dbl_ = objs[i]->internalRep.doubleValue;                      \
+            else if (TclhObjIntrepToWide(objs[i], &wide_))                    \
+                dbl_ = (double)wide_;                                         \
+            else if (Tcl_GetDoubleFromObj(interp, objs[i], &dbl_) != TCL_OK)  \
+                return TCL_ERROR;                                             \
+            if (sizeof(ctype_) < sizeof(double) && !TclhDoubleFitsFloat(dbl_)) \
+                return Tclh_ErrorInvalidValue(                                \
+                    interp, objs[i], "Value out of range for a float.");      \
+            p_[i] = (ctype_)dbl_;                                             \
+        }                                                                     \
+    } while (0)
+
+    switch (type) {
+    case TCLH_NATIVE_SCHAR:
+        TCLH_OBJS_TO_INTS(signed char, SCHAR_MIN, SCHAR_MAX);
+        break;
+    case TCLH_NATIVE_UCHAR:
+        TCLH_OBJS_TO_INTS(unsigned char, 0, UCHAR_MAX);
+        break;
+    case TCLH_NATIVE_SHORT:
+        TCLH_OBJS_TO_INTS(short, SHRT_MIN, SHRT_MAX);
+        break;
+    case TCLH_NATIVE_USHORT:
+        TCLH_OBJS_TO_INTS(unsigned short, 0, USHRT_MAX);
+        break;
+    case TCLH_NATIVE_INT:
+        TCLH_OBJS_TO_INTS(int, INT_MIN, INT_MAX);
+        break;
+    case TCLH_NATIVE_UINT:
+        TCLH_OBJS_TO_INTS(unsigned int, 0, UINT_MAX);
+        break;
+    case TCLH_NATIVE_LONG:
+        TCLH_OBJS_TO_INTS(long, LONG_MIN, LONG_MAX);
+        break;
+    case TCLH_NATIVE_ULONG:
+        if (sizeof(unsigned long) < sizeof(Tcl_WideInt))
+            TCLH_OBJS_TO_INTS(unsigned long, 0, ULONG_MAX);
+        else
+            TCLH_OBJS_TO_UNSIGNED64(unsigned long);
+        break;
+    case TCLH_NATIVE_LONGLONG:
+        TCLH_OBJS_TO_INTS(long long, LLONG_MIN, LLONG_MAX);
+        break;
+    case TCLH_NATIVE_ULONGLONG:
+        TCLH_OBJS_TO_UNSIGNED64(unsigned long long);
+        break;
+    case TCLH_NATIVE_FLOAT:
+        TCLH_OBJS_TO_REALS(float);
+        break;
+    case TCLH_NATIVE_DOUBLE:
+        TCLH_OBJS_TO_REALS(double);
+        break;
+    default:
+        return Tclh_ErrorInvalidValueStr(
+            interp, NULL, "Invalid native type for array conversion.");
+    }
+
+#undef TCLH_OBJS_TO_INTS
+#undef TCLH_OBJS_TO_UNSIGNED64
+#undef TCLH_OBJS_TO_REALS
+
+    return TCL_OK;
+}
+
+Tclh_ReturnCode
+Tclh_ObjListToNativeArray(Tcl_Interp *interp,
+                          Tclh_NativeType type,
+                          Tcl_Obj *listObj,
+                          void *dstP,
+                          Tcl_Size dstCount,
+                          Tcl_Size *numElemsP)
+{
+    Tcl_Obj **objs;
+    Tcl_Size nobjs;
+
+    if (Tcl_ListObjGetElements(interp, listObj, &nobjs, &objs) != TCL_OK)
+        return TCL_ERROR;
+    if (nobjs > dstCount) {
+        return Tclh_ErrorGeneric(
+            interp,
+            NULL,
+            "Number of list elements exceeds capacity of native array.");
+    }
+    if (TclhObjsToNativeArray(interp, type, nobjs, objs, dstP) != TCL_OK)
+        return TCL_ERROR;
+    if (numElemsP)
+        *numElemsP = nobjs;
+    return TCL_OK;
+}
+
+Tcl_Obj *
+Tclh_ObjListFromNativeArray(Tclh_NativeType type,
+                            const void *srcP,
+                            Tcl_Size count)
+{
+#define TCLH_LIST_STATIC 64     /* Elements for which no allocation needed */
+    Tcl_Obj *staticObjs[TCLH_LIST_STATIC];
+    TclhObjSharedCache *cacheP;
+    Tcl_Obj **objs;
+    Tcl_Obj *listObj;
+    Tcl_Size i;
+
+    if (Tclh_NativeTypeSize(type) == 0)
+        return NULL;
+    if (count <= 0)
+        return Tcl_NewListObj(0, NULL);
+
+    if (count > TCLH_LIST_STATIC) {
+        /* Tcl_Alloc in 8.6 takes an unsigned int so guard the product */
+        if ((size_t)count > TCL_SIZE_MAX / sizeof(*objs))
+            return NULL;
+        objs = (Tcl_Obj **)Tcl_Alloc(count * sizeof(*objs));
+    } else
+        objs = staticObjs;
+    cacheP = TclhObjGetSharedCache();
+
+#define TCLH_INTS_TO_OBJS(ctype_)                                             \
+    do {                                                                      \
+        const ctype_ *p_ = (const ctype_ *)srcP;                              \
+        for (i = 0; i < count; ++i) {                                         \
+            Tcl_WideInt wide_ = (Tcl_WideInt)p_[i];                           \
+            if (TCLH_OBJ_IS_SMALLINT(wide_))                                  \
+                objs[i] = TclhObjSharedIntFromCache(cacheP, wide_);           \
+            else                                                              \
+                objs[i] = Tcl_NewWideIntObj(wide_);                           \
+        }                                                                     \
+    } while (0)
+
+#define TCLH_UNSIGNED64_TO_OBJS(ctype_)                                       \
+    do {                                                                      \
+        const ctype_ *p_ = (const ctype_ *)srcP;                              \
+        for (i = 0; i < count; ++i) {                                         \
+            unsigned long long ull_ = (unsigned long long)p_[i];              \
+            if (ull_ <= LLONG_MAX && TCLH_OBJ_IS_SMALLINT((Tcl_WideInt)ull_)) \
+                objs[i] = TclhObjSharedIntFromCache(cacheP, (Tcl_WideInt)ull_); \
+            else                                                              \
+                objs[i] = Tclh_ObjFromULongLong(ull_);                        \
+        }                                                                     \
+    } while (0)
+
+#define TCLH_REALS_TO_OBJS(ctype_)                                            \
+    do {                                                                      \
+        const ctype_ *p_ = (const ctype_ *)srcP;                              \
+        for (i = 0; i < count; ++i)                                           \
+            objs[i] = Tcl_NewDoubleObj((double)p_[i]);                        \
+    } while (0)
+
+    switch (type) {
+    case TCLH_NATIVE_SCHAR: TCLH_INTS_TO_OBJS(signed char); break;
+    case TCLH_NATIVE_UCHAR: TCLH_INTS_TO_OBJS(unsigned char); break;
+    case TCLH_NATIVE_SHORT: TCLH_INTS_TO_OBJS(short); break;
+    case TCLH_NATIVE_USHORT: TCLH_INTS_TO_OBJS(unsigned short); break;
+    case TCLH_NATIVE_INT: TCLH_INTS_TO_OBJS(int); break;
+    case TCLH_NATIVE_UINT: TCLH_INTS_TO_OBJS(unsigned int); break;
+    case TCLH_NATIVE_LONG: TCLH_INTS_TO_OBJS(long); break;
+    case TCLH_NATIVE_ULONG:
+        if (sizeof(unsigned long) < sizeof(Tcl_WideInt))
+            TCLH_INTS_TO_OBJS(unsigned long);
+        else
+            TCLH_UNSIGNED64_TO_OBJS(unsigned long);
+        break;
+    case TCLH_NATIVE_LONGLONG: TCLH_INTS_TO_OBJS(long long); break;
+    case TCLH_NATIVE_ULONGLONG:
+        TCLH_UNSIGNED64_TO_OBJS(unsigned long long);
+        break;
+    case TCLH_NATIVE_FLOAT: TCLH_REALS_TO_OBJS(float); break;
+    case TCLH_NATIVE_DOUBLE: TCLH_REALS_TO_OBJS(double); break;
+    }
+
+#undef TCLH_INTS_TO_OBJS
+#undef TCLH_UNSIGNED64_TO_OBJS
+#undef TCLH_REALS_TO_OBJS
+
+    /* Exact capacity, element reference counts incremented by the list */
+    listObj = Tcl_NewListObj(count, objs);
+    if (objs != staticObjs)
+        Tcl_Free((char *)objs);
+    return listObj;
+}
+
+#ifdef TCLH_LIFO_E_SUCCESS
+Tclh_ReturnCode
+Tclh_ObjListToNativeArrayLifo(Tcl_Interp *interp,
+                              Tclh_NativeType type,
+                              Tcl_Obj *listObj,
+                              Tclh_Lifo *lifoP,
+                              void **arrayPP,
+                              Tcl_Size *numElemsP)
+{
+    Tcl_Obj **objs;
+    Tcl_Size nobjs;
+    size_t elemSize;
+    void *arrayP;
+
+    if (Tcl_ListObjGetElements(interp, listObj, &nobjs, &objs) != TCL_OK)
+        return TCL_ERROR;
+    elemSize = Tclh_NativeTypeSize(type);
+    if (elemSize == 0) {
+        return Tclh_ErrorInvalidValueStr(
+            interp, NULL, "Invalid native type for array conversion.");
+    }
+    /* Always allocate at least one element so caller gets a valid pointer */
+    arrayP = Tclh_LifoAlloc(lifoP, (nobjs ? nobjs : 1) * elemSize);
+    if (arrayP == NULL)
+        return Tclh_ErrorAllocation(interp, "Native array", NULL);
+    if (TclhObjsToNativeArray(interp, type, nobjs, objs, arrayP) != TCL_OK)
+        return TCL_ERROR;
+    *arrayPP = arrayP;
+    if (numElemsP)
+        *numElemsP = nobjs;
+    return TCL_OK;
+}
+#endif
+
 Tcl_Obj *Tclh_ObjFromAddress (void *address)
 {
     char buf[40];
@@ -443,4 +968,290 @@ Tcl_Obj* Tclh_ObjFromDString(Tcl_DString *dsPtr)
     return result;
 
 }
-#endif /* TCLH_TCL87API */
\ No newline at end of file
+#endif /* TCLH_TCL87API */
+/*
+ * Mapped files: Tcl_Obj custom type
+ * The internal representation is a pointer to a reference counted
+ * TclhMappedFile stored in Tcl_Obj.internalRep.twoPtrValue.ptr1. Duplicates
+ * share the mapping.
+ */
+
+typedef struct TclhMappedFile {
+    Tcl_Size nRefs;   /* Number of Tcl_Obj's referencing the mapping */
+    char *base;       /* Start of mapped view. NULL for empty files */
+    Tcl_Size length;  /* Length of mapped view */
+} TclhMappedFile;
+
+static void DupMappedFileObj(Tcl_Obj *srcObj, Tcl_Obj *dstObj);
+static void FreeMappedFileObj(Tcl_Obj *objP);
+static void StringFromMappedFileObj(Tcl_Obj *objP);
+
+static struct Tcl_ObjType gMappedFileVtbl = {
+    "Tclh_MappedFile",
+    FreeMappedFileObj,
+    DupMappedFileObj,
+    StringFromMappedFileObj,
+    NULL
+};
+TCLH_INLINE TclhMappedFile *IntrepGetMappedFile(Tcl_Obj *objP) {
+    return (TclhMappedFile *) objP->internalRep.twoPtrValue.ptr1;
+}
+TCLH_INLINE void IntrepSetMappedFile(Tcl_Obj *objP, TclhMappedFile *mapP) {
+    objP->internalRep.twoPtrValue.ptr1 = (void *) mapP;
+    objP->internalRep.twoPtrValue.ptr2 = NULL;
+}
+
+static void
+TclhMappedFileRelease(TclhMappedFile *mapP)
+{
+    if (--mapP->nRefs > 0)
+        return;
+    if (mapP->base) {
+#ifdef _WIN32
+        UnmapViewOfFile(mapP->base);
+#else
+        munmap(mapP->base, mapP->length);
+#endif
+    }
+    Tcl_Free((char *)mapP);
+}
+
+static void DupMappedFileObj(Tcl_Obj *srcObj, Tcl_Obj *dstObj)
+{
+    TclhMappedFile *mapP = IntrepGetMappedFile(srcObj);
+    mapP->nRefs++;
+    IntrepSetMappedFile(dstObj, mapP);
+    dstObj->typePtr = &gMappedFileVtbl;
+}
+
+static void FreeMappedFileObj(Tcl_Obj *objP)
+{
+    TclhMappedFile *mapP = IntrepGetMappedFile(objP);
+    if (mapP)
+        TclhMappedFileRelease(mapP);
+    IntrepSetMappedFile(objP, NULL);
+    objP->typePtr = NULL;
+}
+
+/*
+ * Generates the same string representation as Tcl does for byte arrays,
+ * i.e. each byte is treated as a Unicode character in the range 0-255.
+ * Done directly from the mapping to avoid an intermediate copy.
+ */
+static void StringFromMappedFileObj(Tcl_Obj *objP)
+{
+    TclhMappedFile *mapP = IntrepGetMappedFile(objP);
+    const unsigned char *from = (const unsigned char *)mapP->base;
+    const unsigned char *end  = from + mapP->length;
+    unsigned char *to;
+    size_t len = mapP->length;
+    const unsigned char *p;
+
+    for (p = from; p < end; ++p) {
+        if (*p == 0 || *p >= 0x80)
+            ++len; /* Two byte UTF-8 sequence */
+    }
+    if (len > (size_t)TCL_SIZE_MAX) {
+        Tcl_Panic("Maximum Tcl string size exceeded for mapped file.");
+    }
+    to = (unsigned char *)Tcl_Alloc(len + 1);
+    objP->bytes  = (char *)to;
+    objP->length = (Tcl_Size)len;
+    for (p = from; p < end; ++p) {
+        if (*p == 0 || *p >= 0x80) {
+            *to++ = (unsigned char)(0xC0 | (*p >> 6));
+            *to++ = (unsigned char)(0x80 | (*p & 0x3F));
+        }
+        else
+            *to++ = *p;
+    }
+    *to = '\0';
+}
+
+/*
+ * Maps the file in copy-on-write mode. *baseP is NULL for empty files.
+ * Only regular files are mapped. pathObj is only used in error messages.
+ */
+static Tclh_ReturnCode
+TclhMapFile(Tcl_Interp *interp,
+            Tcl_Obj *pathObj,
+            const void *nativePath,
+            char **baseP,
+            Tcl_WideInt *sizeP)
+{
+    char *base = NULL;
+    Tcl_WideInt size;
+
+#ifdef _WIN32
+    {
+        HANDLE fileH, mapH;
+        LARGE_INTEGER li;
+
+        fileH = CreateFileW((const WCHAR *)nativePath,
+                            GENERIC_READ,
+                            FILE_SHARE_READ | FILE_SHARE_DELETE,
+                            NULL,
+                            OPEN_EXISTING,
+                            FILE_ATTRIBUTE_NORMAL,
+                            NULL);
+        if (fileH == INVALID_HANDLE_VALUE) {
+            return Tclh_ErrorWindowsError(
+                interp, GetLastError(), "Could not open file.");
+        }
+        if (GetFileType(fileH) != FILE_TYPE_DISK) {
+            CloseHandle(fileH);
+            return Tclh_ErrorInvalidValue(
+                interp, pathObj, "Not a regular file.");
+        }
+        if (!GetFileSizeEx(fileH, &li)) {
+            Tclh_ErrorWindowsError(
+                interp, GetLastError(), "Could not get file size.");
+            CloseHandle(fileH);
+            return TCL_ERROR;
+        }
+        size = li.QuadPart;
+        if (size > TCL_SIZE_MAX) {
+            CloseHandle(fileH);
+            return Tclh_ErrorGeneric(interp, "LIMIT", "File too large to map.");
+        }
+        if (size > 0) {
+            /* Copy-on-write so modifications never reach the file */
+            mapH = CreateFileMappingW(fileH, NULL, PAGE_WRITECOPY, 0, 0, NULL);
+            if (mapH == NULL) {
+                Tclh_ErrorWindowsError(
+                    interp, GetLastError(), "Could not map file.");
+                CloseHandle(fileH);
+                return TCL_ERROR;
+            }
+            base = (char *)MapViewOfFile(mapH, FILE_MAP_COPY, 0, 0, 0);
+            if (base == NULL) {
+                Tclh_ErrorWindowsError(
+                    interp, GetLastError(), "Could not map file.");
+            }
+            /* The view keeps the mapping alive */
+            CloseHandle(mapH);
+        }
+        CloseHandle(fileH);
+        if (size > 0 && base == NULL)
+            return TCL_ERROR;
+    }
+#else
+    {
+        int fd;
+        struct stat st;
+
+        /* O_NONBLOCK so opening a FIFO does not wait for a writer */
+        fd = open((const char *)nativePath, O_RDONLY | O_NONBLOCK);
+        if (fd < 0)
+            return Tclh_ErrorErrnoError(interp, errno, "Could not open file.");
+        if (fstat(fd, &st) != 0) {
+            Tclh_ErrorErrnoError(interp, errno, "Could not get file size.");
+            close(fd);
+            return TCL_ERROR;
+        }
+        if (!S_ISREG(st.st_mode)) {
+            close(fd);
+            return Tclh_ErrorInvalidValue(
+                interp, pathObj, "Not a regular file.");
+        }
+        size = (Tcl_WideInt)st.st_size;
+        if (size > TCL_SIZE_MAX) {
+            close(fd);
+            return Tclh_ErrorGeneric(interp, "LIMIT", "File too large to map.");
+        }
+        if (size > 0) {
+            /* MAP_PRIVATE so modifications never reach the file */
+            base = (char *)mmap(
+                NULL, (size_t)size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+            if (base == (char *)MAP_FAILED) {
+                Tclh_ErrorErrnoError(interp, errno, "Could not map file.");
+                close(fd);
+                return TCL_ERROR;
+            }
+        }
+        close(fd); /* The mapping stays valid */
+    }
+#endif
+
+    *baseP = base;
+    *sizeP = size;
+    return TCL_OK;
+}
+
+Tclh_ReturnCode
+Tclh_ObjFromMappedFile(Tcl_Interp *interp, Tcl_Obj *pathObj, Tcl_Obj **objPP)
+{
+    TclhMappedFile *mapP;
+    Tcl_Obj *objP;
+    const void *nativePath;
+    char *base;
+    Tcl_WideInt size;
+    Tclh_ReturnCode ret;
+
+    /* The caller holds the reference required by the filesystem calls */
+    nativePath = Tcl_FSGetNativePath(pathObj);
+    if (nativePath == NULL)
+        ret = Tclh_ErrorNotFound(interp, "File", pathObj, NULL);
+    else
+        ret = TclhMapFile(interp, pathObj, nativePath, &base, &size);
+    if (ret != TCL_OK)
+        return ret;
+
+    mapP = (TclhMappedFile *)Tcl_Alloc(sizeof(*mapP));
+    mapP->nRefs  = 1;
+    mapP->base   = base;
+    mapP->length = (Tcl_Size)size;
+
+    objP = Tcl_NewObj();
+    Tcl_InvalidateStringRep(objP);
+    IntrepSetMappedFile(objP, mapP);
+    objP->typePtr = &gMappedFileVtbl;
+    *objPP = objP;
+    return TCL_OK;
+}
+
+char *
+Tclh_ObjGetMappedBytes(Tcl_Obj *objP, Tcl_Size *lenPtr)
+{
+    static char emptyBytes[1];
+    TclhMappedFile *mapP;
+
+    if (objP->typePtr != &gMappedFileVtbl)
+        return NULL;
+    mapP = IntrepGetMappedFile(objP);
+    if (lenPtr)
+        *lenPtr = mapP->length;
+    return mapP->base ? mapP->base : emptyBytes;
+}
+
+char *
+Tclh_ObjGetBytesWritable(Tcl_Interp *interp, Tcl_Obj *objP, Tcl_Size *lenPtr)
+{
+    char *bytes;
+
+    if (Tcl_IsShared(objP)) {
+        Tclh_ErrorGeneric(
+            interp, NULL, "Internal error: attempt to modify a shared value.");
+        return NULL;
+    }
+    if (objP->typePtr == &gMappedFileVtbl) {
+        TclhMappedFile *mapP = IntrepGetMappedFile(objP);
+        if (mapP->nRefs == 1) {
+            /* Sole owner. Writes go to private copy-on-write pages. */
+            Tcl_InvalidateStringRep(objP);
+            return Tclh_ObjGetMappedBytes(objP, lenPtr);
+        }
+        /*
+         * Mapping shared with duplicates. Copy to a regular byte array.
+         * Hold a reference as Tcl_SetByteArrayObj frees the internal rep
+         * before copying.
+         */
+        mapP->nRefs++;
+        Tcl_SetByteArrayObj(objP, (unsigned char *)mapP->base, mapP->length);
+        TclhMappedFileRelease(mapP);
+    }
+    bytes = Tclh_ObjGetBytesByRef(interp, objP, lenPtr);
+    if (bytes)
+        Tcl_InvalidateStringRep(objP);
+    return bytes;
+}
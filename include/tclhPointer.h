@@ -520,6 +520,29 @@ TCLH_LOCAL Tcl_Obj *Tclh_PointerWrap(void *pointer, Tclh_PointerTypeTag tag);
 TCLH_LOCAL Tclh_ReturnCode
 Tclh_PointerUnwrap(Tcl_Interp *interp, Tcl_Obj *objP, void **pointerP);
 
+/* Function: Tclh_PointerIsObjIntrep
+ * Checks if the passed Tcl_Obj currently holds an internal representation
+ * of a pointer.
+ *
+ * Parameters:
+ * objP - the Tcl_Obj to be checked.
+ * pointerP - if not NULL, location to store the pointer value if the
+ *            function returns 1.
+ * tagP - if not NULL, location to store the pointer tag if the function
+ *            returns 1.
+ *
+ * Unlike <Tclh_PointerUnwrap>, the function never converts the internal
+ * representation of *objP* and can be used to cheaply check whether a value
+ * that may be one of several types is a pointer.
+ *
+ * Returns:
+ * 1 - Current internal representation holds a pointer.
+ * 0 - otherwise.
+ */
+TCLH_LOCAL Tclh_Bool Tclh_PointerIsObjIntrep(Tcl_Obj *objP,
+                                             void **pointerP,
+                                             Tclh_PointerTypeTag *tagP);
+
 /* Function: Tclh_PointerUnwrapTagged
  * Unwraps a Tcl_Obj representing a pointer checking it is of the
  * expected type. No checks are made with respect to its registration.
@@ -836,6 +859,7 @@ Tclh_ErrorPointerObjRegistration(Tcl_Interp *interp,
 #define PointerObjVerifyAnyOf     Tclh_PointerObjVerifyAnyOf
 #define PointerWrap               Tclh_PointerWrap
 #define PointerUnwrap             Tclh_PointerUnwrap
+#define PointerIsObjIntrep        Tclh_PointerIsObjIntrep
 #define PointerObjGetTag          Tclh_PointerGetTag
 #define PointerUnwrapAnyOf        Tclh_PointerUnwrapAnyOf
 #define PointerEnumerate          Tclh_PointerEnumerate
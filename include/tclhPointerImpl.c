@@ -260,6 +260,18 @@ Tclh_PointerUnwrap(Tcl_Interp *interp, Tcl_Obj *objP, void **pvP)
     return TCL_OK;
 }
 
+Tclh_Bool
+Tclh_PointerIsObjIntrep(Tcl_Obj *objP, void **pvP, Tclh_PointerTypeTag *tagP)
+{
+    if (objP->typePtr != &gPointerType)
+        return 0;
+    if (pvP)
+        *pvP = PointerValueGet(objP);
+    if (tagP)
+        *tagP = PointerTypeGet(objP);
+    return 1;
+}
+
 Tclh_ReturnCode
 Tclh_PointerUnwrapTagged(Tcl_Interp *interp,
                          Tclh_LibContext *tclhCtxP,
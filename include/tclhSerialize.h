@@ -0,0 +1,191 @@
+#ifndef TCLHSERIALIZE_H
+#define TCLHSERIALIZE_H
+
+/*
+ * Copyright (c) 2024, Ashok P. Nadkarni
+ * All rights reserved.
+ *
+ * See the file LICENSE for license
+ */
+
+#include "tclhBase.h"
+#include "tclhObj.h"
+
+/* Section: Value serialization
+ *
+ * Converts Tcl values to and from a compact tagged binary format suitable
+ * for caching or passing between processes. Values whose internal
+ * representation is an integer, double, bignum, list, dict or byte array
+ * are written from the internal representation and recreated with the same
+ * internal representation so that a round trip does not require generation
+ * and parsing of string representations. If the UUID (tclhUuid.h) or
+ * Pointer (tclhPointer.h) modules are included before this header, UUID
+ * and pointer values are handled in the same manner. All other values are
+ * written as strings.
+ *
+ * A value is only written from its internal representation if doing so
+ * does not change its string value. Thus an integer with the string
+ * representation *0x10* is written as a string and lists and dicts that
+ * already have a string representation are written as strings since their
+ * string form may not be canonical.
+ *
+ * The serialized form begins with a format version byte followed by the
+ * tagged value. Integers and lengths are written as variable length
+ * integers so small values take a single byte. Multibyte numeric values
+ * are written in little endian order. UUIDs are written as their 16 bytes
+ * in native layout. Pointers are written as their address and tag. Note
+ * pointer registrations are not serialized and a deserialized pointer
+ * will not be registered in the receiving process.
+ *
+ * The Serialize module must be initialized with <Tclh_SerializeLibInit>
+ * before use.
+ */
+
+/* Function: Tclh_SerializeLibInit
+ * Must be called to initialize the Serialize module before any of
+ * the other functions in the module.
+ *
+ * Parameters:
+ * interp - Tcl interpreter for error messages. May be NULL.
+ * tclhCtxP - Tclh context as returned by <Tclh_LibInit> to use. If NULL,
+ *    the Tclh context associated with the interpreter is used after
+ *    initialization if necessary.
+ *
+ * At least one of interp and tclhCtxP must be non-NULL. The function also
+ * initializes the Obj module.
+ *
+ * Returns:
+ * TCL_OK    - Library was successfully initialized.
+ * TCL_ERROR - Initialization failed. Library functions must not be called.
+ *             An error message is left in the interpreter result.
+ */
+TCLH_LOCAL Tclh_ReturnCode Tclh_SerializeLibInit(Tcl_Interp *interp,
+                                                 Tclh_LibContext *tclhCtxP);
+
+/* Function: Tclh_ObjSerialize
+ * Serializes a Tcl value into a byte array.
+ *
+ * Parameters:
+ * interp - Interpreter for error messages. May be NULL.
+ * objP - the value to serialize
+ * bytesObjP - location to store the byte array Tcl_Obj holding the
+ *    serialized value. This will have a zero reference count.
+ *
+ * The internal representation of *objP* and any nested values is not
+ * modified.
+ *
+ * Returns:
+ * TCL_OK on success, TCL_ERROR with an error message in the interpreter
+ * if the value is nested too deeply.
+ */
+TCLH_LOCAL Tclh_ReturnCode Tclh_ObjSerialize(Tcl_Interp *interp,
+                                             Tcl_Obj *objP,
+                                             Tcl_Obj **bytesObjP);
+
+/* Function: Tclh_ObjSerializeToChannel
+ * Serializes a Tcl value to a channel.
+ *
+ * Parameters:
+ * interp - Interpreter for error messages. May be NULL.
+ * objP - the value to serialize
+ * chan - the channel to write to. This must be configured for binary
+ *    translation.
+ *
+ * The value is written as it is serialized through a fixed size buffer
+ * without building the complete serialized form in memory. On error, a
+ * partial value may have been written to the channel.
+ *
+ * Returns:
+ * TCL_OK on success, TCL_ERROR with an error message in the interpreter.
+ */
+TCLH_LOCAL Tclh_ReturnCode Tclh_ObjSerializeToChannel(Tcl_Interp *interp,
+                                                      Tcl_Obj *objP,
+                                                      Tcl_Channel chan);
+
+#ifdef TCLH_LIFO_E_SUCCESS
+/* Function: Tclh_ObjSerializeToLifo
+ * Serializes a Tcl value into memory allocated from a Lifo memory pool.
+ *
+ * Parameters:
+ * interp - Interpreter for error messages. May be NULL.
+ * objP - the value to serialize
+ * lifoP - the memory pool to allocate from
+ * bufPP - location to store a pointer to the serialized value
+ * lenP - location to store the length of the serialized value
+ *
+ * The serialized value is built in a single block allocated from the pool
+ * which is grown as needed. The block is freed when the pool is popped
+ * to a mark preceding the call. The Lifo module (tclhLifo.h) must be
+ * included before this header for this function to be available.
+ *
+ * Returns:
+ * TCL_OK on success, TCL_ERROR with an error message in the interpreter.
+ */
+TCLH_LOCAL Tclh_ReturnCode Tclh_ObjSerializeToLifo(Tcl_Interp *interp,
+                                                   Tcl_Obj *objP,
+                                                   Tclh_Lifo *lifoP,
+                                                   void **bufPP,
+                                                   Tcl_Size *lenP);
+#endif
+
+/* Function: Tclh_ObjDeserialize
+ * Recreates a Tcl value from its serialized form.
+ *
+ * Parameters:
+ * interp - Interpreter for error messages. May be NULL.
+ * bufP - the serialized value
+ * len - number of bytes in *bufP*
+ * objPP - location to store the recreated value. Small integers may be
+ *    shared as for <Tclh_ObjSharedInt> so the reference count is not
+ *    necessarily zero.
+ * usedP - location to store the number of bytes consumed. May be NULL in
+ *    which case it is an error if the serialized value does not occupy all
+ *    of *bufP*.
+ *
+ * Returns:
+ * TCL_OK on success, TCL_ERROR with an error message in the interpreter
+ * if the data is not a valid serialized value.
+ */
+TCLH_LOCAL Tclh_ReturnCode Tclh_ObjDeserialize(Tcl_Interp *interp,
+                                               const void *bufP,
+                                               Tcl_Size len,
+                                               Tcl_Obj **objPP,
+                                               Tcl_Size *usedP);
+
+/* Function: Tclh_ObjDeserializeFromChannel
+ * Reads a serialized Tcl value from a channel.
+ *
+ * Parameters:
+ * interp - Interpreter for error messages. May be NULL.
+ * chan - the channel to read from. This must be configured for binary
+ *    translation.
+ * objPP - location to store the recreated value. Small integers may be
+ *    shared as for <Tclh_ObjSharedInt> so the reference count is not
+ *    necessarily zero.
+ *
+ * Exactly the bytes making up one serialized value are read from the
+ * channel so multiple values may be written to and read from a channel
+ * in sequence.
+ *
+ * Returns:
+ * TCL_OK on success, TCL_ERROR with an error message in the interpreter
+ * if the data is not a valid serialized value or could not be read.
+ */
+TCLH_LOCAL Tclh_ReturnCode Tclh_ObjDeserializeFromChannel(Tcl_Interp *interp,
+                                                          Tcl_Channel chan,
+                                                          Tcl_Obj **objPP);
+
+#ifdef TCLH_SHORTNAMES
+#define SerializeLibInit           Tclh_SerializeLibInit
+#define ObjSerialize               Tclh_ObjSerialize
+#define ObjSerializeToChannel      Tclh_ObjSerializeToChannel
+#define ObjSerializeToLifo         Tclh_ObjSerializeToLifo
+#define ObjDeserialize             Tclh_ObjDeserialize
+#define ObjDeserializeFromChannel  Tclh_ObjDeserializeFromChannel
+#endif
+
+#ifdef TCLH_IMPL
+#include "tclhSerializeImpl.c"
+#endif
+
+#endif /* TCLHSERIALIZE_H */
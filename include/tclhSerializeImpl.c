@@ -0,0 +1,943 @@
+/*
+ * Copyright (c) 2024, Ashok P. Nadkarni
+ * All rights reserved.
+ *
+ * See the file LICENSE for license
+ */
+
+#include "tclhSerialize.h"
+
+#define TCLH_SERIALIZE_VERSION 1
+
+/* Maximum nesting of lists and dicts, guards against stack exhaustion */
+#ifndef TCLH_SERIALIZE_MAX_DEPTH
+#define TCLH_SERIALIZE_MAX_DEPTH 1000
+#endif
+
+/* Size of the staging buffer used when writing to a channel */
+#define TCLH_SERIALIZE_CHAN_BUFSIZE 4096
+
+/*
+ * Chunk size for reading strings and byte arrays from a channel. The
+ * length in the stream is not trusted so memory is only allocated as
+ * data actually arrives.
+ */
+#define TCLH_SERIALIZE_READ_CHUNK 65536
+
+/* Value tags. These are part of the format and must not be changed. */
+enum TclhSerializeTag {
+    TCLH_SERIALIZE_STRING  = 0,
+    TCLH_SERIALIZE_INT     = 1,
+    TCLH_SERIALIZE_DOUBLE  = 2,
+    TCLH_SERIALIZE_BIGNUM  = 3,
+    TCLH_SERIALIZE_LIST    = 4,
+    TCLH_SERIALIZE_DICT    = 5,
+    TCLH_SERIALIZE_BYTES   = 6,
+    TCLH_SERIALIZE_UUID    = 7,
+    TCLH_SERIALIZE_POINTER = 8
+};
+
+static const Tcl_ObjType *gTclhSerializeListType;
+static const Tcl_ObjType *gTclhSerializeDictType;
+static const Tcl_ObjType *gTclhSerializeByteArrayType;
+
+Tclh_ReturnCode
+Tclh_SerializeLibInit(Tcl_Interp *interp, Tclh_LibContext *tclhCtxP)
+{
+    TCLH_CHECK_RESULT(Tclh_ObjLibInit(interp, tclhCtxP));
+    gTclhSerializeListType      = Tcl_GetObjType("list");
+    gTclhSerializeDictType      = Tcl_GetObjType("dict");
+    gTclhSerializeByteArrayType = Tcl_GetObjType("bytearray");
+    return TCL_OK;
+}
+
+/* Returns 1 if objP has the internal representation typeP. */
+TCLH_INLINE int
+TclhSerializeHasType(Tcl_Obj *objP, const Tcl_ObjType *typeP)
+{
+    /* typeP may be NULL if not registered. Do not match pure strings! */
+    return typeP != NULL && objP->typePtr == typeP;
+}
+
+/*
+ * Output state. Exactly one of bytesObj, chan and lifoP is set and
+ * determines how bufP is grown or flushed when full.
+ */
+typedef struct TclhSerializeWriter {
+    Tcl_Interp *interp;
+    unsigned char *bufP; /* Output buffer */
+    size_t used;         /* Number of bytes in bufP */
+    size_t capacity;     /* Size of bufP */
+    Tcl_Obj *bytesObj;   /* If not NULL, bufP is the storage of this byte
+                            array */
+    Tcl_Channel chan;    /* If not NULL, bufP is flushed to this channel */
+#ifdef TCLH_LIFO_E_SUCCESS
+    Tclh_Lifo *lifoP;    /* If not NULL, bufP is the last block allocated
+                            from this pool */
+#endif
+    int depth;           /* Current nesting level */
+} TclhSerializeWriter;
+
+static Tclh_ReturnCode
+TclhSerializeFlush(TclhSerializeWriter *wP)
+{
+    TCLH_ASSERT(wP->chan);
+    if (wP->used) {
+        if (Tcl_Write(wP->chan, (const char *)wP->bufP, (Tcl_Size)wP->used)
+            != (Tcl_Size)wP->used) {
+            return Tclh_ErrorErrnoError(
+                wP->interp, Tcl_GetErrno(), "Could not write to channel.");
+        }
+        wP->used = 0;
+    }
+    return TCL_OK;
+}
+
+/*
+ * Makes room for at least need bytes in the output buffer. For channels
+ * the buffer is flushed and the caller must handle need exceeding the
+ * buffer capacity.
+ */
+static Tclh_ReturnCode
+TclhSerializeGrow(TclhSerializeWriter *wP, size_t need)
+{
+    size_t newCapacity;
+
+    if (wP->chan)
+        return TclhSerializeFlush(wP);
+
+    if (need > (size_t)TCL_SIZE_MAX - wP->used) {
+        return Tclh_ErrorGeneric(
+            wP->interp, "LIMIT", "Serialized value exceeds maximum size.");
+    }
+    newCapacity = wP->capacity * 2;
+    if (newCapacity < wP->used + need)
+        newCapacity = wP->used + need;
+    if (newCapacity > (size_t)TCL_SIZE_MAX)
+        newCapacity = TCL_SIZE_MAX;
+
+#ifdef TCLH_LIFO_E_SUCCESS
+    if (wP->lifoP) {
+        unsigned char *newP;
+        newP = (unsigned char *)Tclh_LifoExpandLast(
+            wP->lifoP, newCapacity - wP->capacity, 0);
+        if (newP == NULL)
+            return Tclh_ErrorAllocation(wP->interp, "Memory", NULL);
+        wP->bufP     = newP;
+        wP->capacity = newCapacity;
+        return TCL_OK;
+    }
+#endif
+
+    TCLH_ASSERT(wP->bytesObj);
+    wP->bufP =
+        Tcl_SetByteArrayLength(wP->bytesObj, (Tcl_Size)newCapacity);
+    wP->capacity = newCapacity;
+    return TCL_OK;
+}
+
+static Tclh_ReturnCode
+TclhSerializeWrite(TclhSerializeWriter *wP, const void *dataP, size_t len)
+{
+    if (len > wP->capacity - wP->used) {
+        TCLH_CHECK_RESULT(TclhSerializeGrow(wP, len));
+        if (len > wP->capacity) {
+            /* Channel and data larger than staging buffer. Write directly. */
+            TCLH_ASSERT(wP->chan && wP->used == 0);
+            if (Tcl_Write(wP->chan, (const char *)dataP, (Tcl_Size)len)
+                != (Tcl_Size)len) {
+                return Tclh_ErrorErrnoError(
+                    wP->interp, Tcl_GetErrno(), "Could not write to channel.");
+            }
+            return TCL_OK;
+        }
+    }
+    memcpy(wP->bufP + wP->used, dataP, len);
+    wP->used += len;
+    return TCL_OK;
+}
+
+/* Writes an unsigned LEB128 variable length integer */
+static Tclh_ReturnCode
+TclhSerializeWriteVarint(TclhSerializeWriter *wP, Tcl_WideUInt value)
+{
+    unsigned char buf[10];
+    int n = 0;
+    while (value >= 0x80) {
+        buf[n++] = (unsigned char)(value | 0x80);
+        value >>= 7;
+    }
+    buf[n++] = (unsigned char)value;
+    return TclhSerializeWrite(wP, buf, n);
+}
+
+/* Writes a tag byte followed by a varint */
+static Tclh_ReturnCode
+TclhSerializeWriteTagged(TclhSerializeWriter *wP,
+                         enum TclhSerializeTag tag,
+                         Tcl_WideUInt value)
+{
+    unsigned char tagByte = (unsigned char)tag;
+    TCLH_CHECK_RESULT(TclhSerializeWrite(wP, &tagByte, 1));
+    return TclhSerializeWriteVarint(wP, value);
+}
+
+static Tclh_ReturnCode
+TclhSerializeWriteUInt64(TclhSerializeWriter *wP, Tcl_WideUInt value)
+{
+    unsigned char buf[8];
+    int i;
+    for (i = 0; i < 8; ++i) {
+        buf[i] = (unsigned char)(value >> (8 * i));
+    }
+    return TclhSerializeWrite(wP, buf, 8);
+}
+
+/*
+ * Returns 1 if the string representation of objP, if any, is identical to
+ * the canonical form canonP generated from its internal representation.
+ */
+static int
+TclhSerializeIsCanonical(Tcl_Obj *objP, const char *canonP, Tcl_Size canonLen)
+{
+    if (objP->bytes == NULL)
+        return 1;
+    return objP->length == canonLen
+        && memcmp(objP->bytes, canonP, canonLen) == 0;
+}
+
+#if defined(TCLHWRAP_H) || defined(TCLHPOINTER_H)
+/* As above but the canonical form is held in a Tcl_Obj which is freed. */
+static int
+TclhSerializeIsCanonicalObj(Tcl_Obj *objP, Tcl_Obj *canonObj)
+{
+    Tcl_Size len;
+    const char *canonP;
+    int canonical;
+
+    if (objP->bytes == NULL)
+        return 1;
+    Tcl_IncrRefCount(canonObj);
+    canonP    = Tcl_GetStringFromObj(canonObj, &len);
+    canonical = TclhSerializeIsCanonical(objP, canonP, len);
+    Tcl_DecrRefCount(canonObj);
+    return canonical;
+}
+#endif
+
+static Tclh_ReturnCode TclhSerializeValue(TclhSerializeWriter *wP,
+                                          Tcl_Obj *objP);
+
+static Tclh_ReturnCode
+TclhSerializeBignum(TclhSerializeWriter *wP, Tcl_Obj *objP)
+{
+    mp_int mp;
+    unsigned char sign;
+    unsigned char smallBuf[64];
+    unsigned char *magP;
+    size_t len, written;
+    Tclh_ReturnCode ret;
+
+    if (Tcl_GetBignumFromObj(wP->interp, objP, &mp) != TCL_OK)
+        return TCL_ERROR;
+    sign = mp.sign == MP_NEG;
+    len  = mp_ubin_size(&mp);
+    magP = len <= sizeof(smallBuf) ? smallBuf : (unsigned char *)ckalloc(len);
+    if (mp_to_ubin(&mp, magP, len, &written) != MP_OKAY) {
+        ret = Tclh_ErrorAllocation(wP->interp, "Memory", NULL);
+    }
+    else {
+        ret = TclhSerializeWriteTagged(wP, TCLH_SERIALIZE_BIGNUM, written);
+        if (ret == TCL_OK)
+            ret = TclhSerializeWrite(wP, &sign, 1);
+        if (ret == TCL_OK)
+            ret = TclhSerializeWrite(wP, magP, written);
+    }
+    if (magP != smallBuf)
+        ckfree(magP);
+    mp_clear(&mp);
+    return ret;
+}
+
+static Tclh_ReturnCode
+TclhSerializeList(TclhSerializeWriter *wP, Tcl_Obj *objP)
+{
+    Tcl_Obj **elems;
+    Tcl_Size i, nelems;
+
+    /* Already a list so no conversion takes place */
+    if (Tcl_ListObjGetElements(wP->interp, objP, &nelems, &elems) != TCL_OK)
+        return TCL_ERROR;
+    TCLH_CHECK_RESULT(
+        TclhSerializeWriteTagged(wP, TCLH_SERIALIZE_LIST, nelems));
+    for (i = 0; i < nelems; ++i) {
+        TCLH_CHECK_RESULT(TclhSerializeValue(wP, elems[i]));
+    }
+    return TCL_OK;
+}
+
+static Tclh_ReturnCode
+TclhSerializeDict(TclhSerializeWriter *wP, Tcl_Obj *objP)
+{
+    Tcl_DictSearch search;
+    Tcl_Obj *keyObj, *valueObj;
+    Tcl_Size size;
+    int done;
+
+    if (Tcl_DictObjSize(wP->interp, objP, &size) != TCL_OK)
+        return TCL_ERROR;
+    TCLH_CHECK_RESULT(TclhSerializeWriteTagged(wP, TCLH_SERIALIZE_DICT, size));
+    if (Tcl_DictObjFirst(
+            wP->interp, objP, &search, &keyObj, &valueObj, &done)
+        != TCL_OK) {
+        return TCL_ERROR;
+    }
+    for (; !done; Tcl_DictObjNext(&search, &keyObj, &valueObj, &done)) {
+        if (TclhSerializeValue(wP, keyObj) != TCL_OK
+            || TclhSerializeValue(wP, valueObj) != TCL_OK) {
+            Tcl_DictObjDone(&search);
+            return TCL_ERROR;
+        }
+    }
+    return TCL_OK;
+}
+
+static Tclh_ReturnCode
+TclhSerializeValue(TclhSerializeWriter *wP, Tcl_Obj *objP)
+{
+    const char *s;
+    Tcl_Size len;
+    Tcl_WideInt wide;
+    Tclh_ReturnCode ret;
+
+    if (objP->typePtr == NULL)
+        goto string;
+
+    /*
+     * Numerics are written from the internal representation only if the
+     * string representation, if present, is the canonical one.
+     */
+    if (TclhObjIntrepToWide(objP, &wide)) {
+        char buf[TCL_INTEGER_SPACE + 10];
+        len = snprintf(buf, sizeof(buf), "%" TCL_LL_MODIFIER "d", wide);
+        if (!TclhSerializeIsCanonical(objP, buf, len))
+            goto string;
+        /* Zigzag encoding so small negative numbers are short */
+        return TclhSerializeWriteTagged(
+            wP,
+            TCLH_SERIALIZE_INT,
+            ((Tcl_WideUInt)wide << 1) ^ (Tcl_WideUInt)(wide >> 63));
+    }
+    if (objP->typePtr == gTclDoubleType) {
+        char buf[TCL_DOUBLE_SPACE];
+        unsigned char tag = TCLH_SERIALIZE_DOUBLE;
+        Tcl_WideUInt bits;
+        double dval = objP->internalRep.doubleValue;
+        if (objP->bytes) {
+            Tcl_PrintDouble(NULL, dval, buf);
+            if (!TclhSerializeIsCanonical(objP, buf, (Tcl_Size)strlen(buf)))
+                goto string;
+        }
+        memcpy(&bits, &dval, sizeof(bits));
+        TCLH_CHECK_RESULT(TclhSerializeWrite(wP, &tag, 1));
+        return TclhSerializeWriteUInt64(wP, bits);
+    }
+
+#ifdef TCLHWRAP_H
+    if (Tclh_UuidIsObjIntrep(objP)) {
+        Tclh_UUID uuid;
+        unsigned char tag = TCLH_SERIALIZE_UUID;
+        if (Tclh_UuidUnwrap(wP->interp, objP, &uuid) != TCL_OK)
+            return TCL_ERROR;
+        if (!TclhSerializeIsCanonicalObj(objP, Tclh_UuidWrap(&uuid)))
+            goto string;
+        TCLH_CHECK_RESULT(TclhSerializeWrite(wP, &tag, 1));
+        return TclhSerializeWrite(wP, &uuid, 16);
+    }
+#endif
+
+#ifdef TCLHPOINTER_H
+    {
+        void *pv;
+        Tclh_PointerTypeTag ptrTag;
+        if (Tclh_PointerIsObjIntrep(objP, &pv, &ptrTag)) {
+            unsigned char bytes[2];
+            if (!TclhSerializeIsCanonicalObj(objP, Tclh_PointerWrap(pv, ptrTag)))
+                goto string;
+            bytes[0] = TCLH_SERIALIZE_POINTER;
+            bytes[1] = ptrTag != NULL;
+            TCLH_CHECK_RESULT(TclhSerializeWrite(wP, &bytes[0], 1));
+            TCLH_CHECK_RESULT(TclhSerializeWriteUInt64(wP, (uintptr_t)pv));
+            TCLH_CHECK_RESULT(TclhSerializeWrite(wP, &bytes[1], 1));
+            return ptrTag ? TclhSerializeValue(wP, ptrTag) : TCL_OK;
+        }
+    }
+#endif
+
+    /*
+     * For the remaining types the string form cannot be cheaply checked for
+     * being canonical so the internal representation is only used for pure
+     * values with no string representation.
+     */
+    if (objP->bytes)
+        goto string;
+
+    if (TclhSerializeHasType(objP, gTclBignumType))
+        return TclhSerializeBignum(wP, objP);
+
+    if (TclhSerializeHasType(objP, gTclhSerializeByteArrayType)
+        || Tclh_ObjGetMappedBytes(objP, NULL)) {
+        s = Tclh_ObjGetBytesReadOnly(wP->interp, objP, &len);
+        if (s == NULL)
+            return TCL_ERROR;
+        TCLH_CHECK_RESULT(TclhSerializeWriteTagged(wP, TCLH_SERIALIZE_BYTES, len));
+        return TclhSerializeWrite(wP, s, len);
+    }
+
+    if (TclhSerializeHasType(objP, gTclhSerializeListType)
+        || TclhSerializeHasType(objP, gTclhSerializeDictType)) {
+        if (wP->depth >= TCLH_SERIALIZE_MAX_DEPTH) {
+            return Tclh_ErrorGeneric(
+                wP->interp, "LIMIT", "Value nesting exceeds maximum depth.");
+        }
+        wP->depth++;
+        if (objP->typePtr == gTclhSerializeListType)
+            ret = TclhSerializeList(wP, objP);
+        else
+            ret = TclhSerializeDict(wP, objP);
+        wP->depth--;
+        return ret;
+    }
+
+string:
+    s = Tcl_GetStringFromObj(objP, &len);
+    TCLH_CHECK_RESULT(TclhSerializeWriteTagged(wP, TCLH_SERIALIZE_STRING, len));
+    return TclhSerializeWrite(wP, s, len);
+}
+
+/* Writes the version header and the value */
+static Tclh_ReturnCode
+TclhSerializeTop(TclhSerializeWriter *wP, Tcl_Obj *objP)
+{
+    unsigned char version = TCLH_SERIALIZE_VERSION;
+    TCLH_ASSERT(gTclIntType);
+    TCLH_CHECK_RESULT(TclhSerializeWrite(wP, &version, 1));
+    return TclhSerializeValue(wP, objP);
+}
+
+Tclh_ReturnCode
+Tclh_ObjSerialize(Tcl_Interp *interp, Tcl_Obj *objP, Tcl_Obj **bytesObjP)
+{
+    TclhSerializeWriter writer;
+
+    memset(&writer, 0, sizeof(writer));
+    writer.interp   = interp;
+    writer.bytesObj = Tcl_NewByteArrayObj(NULL, 0);
+    writer.capacity = 64;
+    writer.bufP =
+        Tcl_SetByteArrayLength(writer.bytesObj, (Tcl_Size)writer.capacity);
+
+    if (TclhSerializeTop(&writer, objP) != TCL_OK) {
+        Tcl_DecrRefCount(writer.bytesObj);
+        return TCL_ERROR;
+    }
+    Tcl_SetByteArrayLength(writer.bytesObj, (Tcl_Size)writer.used);
+    *bytesObjP = writer.bytesObj;
+    return TCL_OK;
+}
+
+Tclh_ReturnCode
+Tclh_ObjSerializeToChannel(Tcl_Interp *interp,
+                           Tcl_Obj *objP,
+                           Tcl_Channel chan)
+{
+    TclhSerializeWriter writer;
+    unsigned char buf[TCLH_SERIALIZE_CHAN_BUFSIZE];
+
+    memset(&writer, 0, sizeof(writer));
+    writer.interp   = interp;
+    writer.chan     = chan;
+    writer.bufP     = buf;
+    writer.capacity = sizeof(buf);
+
+    TCLH_CHECK_RESULT(TclhSerializeTop(&writer, objP));
+    return TclhSerializeFlush(&writer);
+}
+
+#ifdef TCLH_LIFO_E_SUCCESS
+Tclh_ReturnCode
+Tclh_ObjSerializeToLifo(Tcl_Interp *interp,
+                        Tcl_Obj *objP,
+                        Tclh_Lifo *lifoP,
+                        void **bufPP,
+                        Tcl_Size *lenP)
+{
+    TclhSerializeWriter writer;
+
+    memset(&writer, 0, sizeof(writer));
+    writer.interp   = interp;
+    writer.lifoP    = lifoP;
+    writer.capacity = 256;
+    writer.bufP     = (unsigned char *)Tclh_LifoAlloc(lifoP, writer.capacity);
+    if (writer.bufP == NULL)
+        return Tclh_ErrorAllocation(interp, "Memory", NULL);
+
+    TCLH_CHECK_RESULT(TclhSerializeTop(&writer, objP));
+    *bufPP = writer.bufP;
+    *lenP  = (Tcl_Size)writer.used;
+    return TCL_OK;
+}
+#endif
+
+/*
+ * Input state. If chan is NULL, input is from the memory range p to end.
+ */
+typedef struct TclhSerializeReader {
+    Tcl_Interp *interp;
+    const unsigned char *p;   /* Current position */
+    const unsigned char *end; /* End of input */
+    Tcl_Channel chan;         /* If not NULL, input is read from channel */
+    int depth;                /* Current nesting level */
+} TclhSerializeReader;
+
+static Tclh_ReturnCode
+TclhDeserializeErrorFormat(TclhSerializeReader *rP, const char *message)
+{
+    return Tclh_ErrorGeneric(rP->interp, "FORMAT", message);
+}
+
+static Tclh_ReturnCode
+TclhDeserializeRead(TclhSerializeReader *rP, void *dstP, size_t len)
+{
+    if (rP->chan) {
+        if (Tcl_Read(rP->chan, (char *)dstP, (Tcl_Size)len) != (Tcl_Size)len) {
+            if (Tcl_Eof(rP->chan))
+                return TclhDeserializeErrorFormat(
+                    rP, "Serialized value is truncated.");
+            return Tclh_ErrorErrnoError(
+                rP->interp, Tcl_GetErrno(), "Could not read from channel.");
+        }
+        return TCL_OK;
+    }
+    if (len > (size_t)(rP->end - rP->p))
+        return TclhDeserializeErrorFormat(rP, "Serialized value is truncated.");
+    memcpy(dstP, rP->p, len);
+    rP->p += len;
+    return TCL_OK;
+}
+
+static Tclh_ReturnCode
+TclhDeserializeReadVarint(TclhSerializeReader *rP, Tcl_WideUInt *valueP)
+{
+    Tcl_WideUInt value = 0;
+    int shift;
+    unsigned char byte;
+
+    for (shift = 0; shift < 64; shift += 7) {
+        TCLH_CHECK_RESULT(TclhDeserializeRead(rP, &byte, 1));
+        value |= (Tcl_WideUInt)(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0) {
+            *valueP = value;
+            return TCL_OK;
+        }
+    }
+    return TclhDeserializeErrorFormat(rP, "Invalid integer encoding.");
+}
+
+/*
+ * Reads a count or length checking it is plausible. For memory input each
+ * item takes at least minItemSize bytes so a count that could not fit in
+ * the remaining input is rejected before anything is allocated.
+ */
+static Tclh_ReturnCode
+TclhDeserializeReadCount(TclhSerializeReader *rP,
+                         size_t minItemSize,
+                         Tcl_Size *countP)
+{
+    Tcl_WideUInt count;
+    TCLH_CHECK_RESULT(TclhDeserializeReadVarint(rP, &count));
+    if (count > (Tcl_WideUInt)TCL_SIZE_MAX
+        || (rP->chan == NULL
+            && count > (Tcl_WideUInt)(rP->end - rP->p) / minItemSize)) {
+        return TclhDeserializeErrorFormat(rP, "Invalid length or count.");
+    }
+    *countP = (Tcl_Size)count;
+    return TCL_OK;
+}
+
+static Tclh_ReturnCode
+TclhDeserializeReadUInt64(TclhSerializeReader *rP, Tcl_WideUInt *valueP)
+{
+    unsigned char buf[8];
+    Tcl_WideUInt value = 0;
+    int i;
+    TCLH_CHECK_RESULT(TclhDeserializeRead(rP, buf, 8));
+    for (i = 7; i >= 0; --i) {
+        value = (value << 8) | buf[i];
+    }
+    *valueP = value;
+    return TCL_OK;
+}
+
+/*
+ * Returns 1 if the len bytes at p are in Tcl's internal UTF-8 form, i.e.
+ * well-formed sequences with NUL only present in its two byte form C0 80.
+ * Surrogates are permitted as Tcl itself may store them.
+ */
+static int
+TclhDeserializeIsUtf8(const unsigned char *p, Tcl_Size len)
+{
+    const unsigned char *end = p + len;
+    int i, ntrail;
+
+    while (p < end) {
+        unsigned char c = *p;
+        if (c < 0x80) {
+            if (c == 0)
+                return 0;
+            ++p;
+            continue;
+        }
+        if (c == 0xC0) {
+            /* Only valid as the encoded NUL */
+            if (end - p < 2 || p[1] != 0x80)
+                return 0;
+            p += 2;
+            continue;
+        }
+        if (c < 0xC2)
+            return 0; /* Stray continuation byte or overlong form */
+        else if (c < 0xE0)
+            ntrail = 1;
+        else if (c < 0xF0)
+            ntrail = 2;
+        else if (c < 0xF5)
+            ntrail = 3;
+        else
+            return 0;
+        if (end - p <= ntrail)
+            return 0;
+        for (i = 1; i <= ntrail; ++i) {
+            if ((p[i] & 0xC0) != 0x80)
+                return 0;
+        }
+        /* Overlong three and four byte forms and values beyond U+10FFFF */
+        if ((c == 0xE0 && p[1] < 0xA0) || (c == 0xF0 && p[1] < 0x90)
+            || (c == 0xF4 && p[1] > 0x8F))
+            return 0;
+        p += ntrail + 1;
+    }
+    return 1;
+}
+
+/* Reads a string or byte array of length len */
+static Tclh_ReturnCode
+TclhDeserializeChars(TclhSerializeReader *rP,
+                     Tcl_Size len,
+                     int isBytes,
+                     Tcl_Obj **objPP)
+{
+    Tcl_Obj *objP;
+    Tcl_Size done;
+
+    if (rP->chan == NULL) {
+        /* Length was already checked against remaining input */
+        if (isBytes)
+            objP = Tcl_NewByteArrayObj(rP->p, len);
+        else {
+            if (!TclhDeserializeIsUtf8(rP->p, len)) {
+                return TclhDeserializeErrorFormat(
+                    rP, "Serialized string is not valid UTF-8.");
+            }
+            objP = Tcl_NewStringObj((const char *)rP->p, len);
+        }
+        rP->p += len;
+        *objPP = objP;
+        return TCL_OK;
+    }
+
+    objP = isBytes ? Tcl_NewByteArrayObj(NULL, 0) : Tcl_NewObj();
+    for (done = 0; done < len;) {
+        char *dstP;
+        Tcl_Size chunk = len - done;
+        if (chunk > TCLH_SERIALIZE_READ_CHUNK)
+            chunk = TCLH_SERIALIZE_READ_CHUNK;
+        if (isBytes) {
+            dstP = (char *)Tcl_SetByteArrayLength(objP, done + chunk);
+        }
+        else {
+            Tcl_SetObjLength(objP, done + chunk);
+            dstP = objP->bytes;
+        }
+        if (TclhDeserializeRead(rP, dstP + done, chunk) != TCL_OK) {
+            Tcl_DecrRefCount(objP);
+            return TCL_ERROR;
+        }
+        done += chunk;
+    }
+    if (!isBytes
+        && !TclhDeserializeIsUtf8((const unsigned char *)objP->bytes, len)) {
+        Tcl_DecrRefCount(objP);
+        return TclhDeserializeErrorFormat(
+            rP, "Serialized string is not valid UTF-8.");
+    }
+    *objPP = objP;
+    return TCL_OK;
+}
+
+static Tclh_ReturnCode
+TclhDeserializeBignum(TclhSerializeReader *rP, Tcl_Obj **objPP)
+{
+    mp_int mp;
+    Tcl_Obj *magObj;
+    const unsigned char *magP;
+    unsigned char sign;
+    Tcl_Size i, len, ndigits, digit;
+    Tcl_WideUInt acc;
+    int nbits;
+
+    TCLH_CHECK_RESULT(TclhDeserializeReadCount(rP, 1, &len));
+    TCLH_CHECK_RESULT(TclhDeserializeRead(rP, &sign, 1));
+    ndigits = (Tcl_Size)(((size_t)len * 8 + MP_DIGIT_BIT - 1) / MP_DIGIT_BIT);
+    if (ndigits > INT_MAX) {
+        return Tclh_ErrorGeneric(
+            rP->interp, "LIMIT", "Serialized bignum is too large.");
+    }
+    /* Read the whole magnitude first as the channel length is not trusted */
+    TCLH_CHECK_RESULT(TclhDeserializeChars(rP, len, 1, &magObj));
+    magP = Tcl_GetByteArrayFromObj(magObj, NULL);
+
+    if (mp_init(&mp) != MP_OKAY || mp_grow(&mp, (int)ndigits) != MP_OKAY) {
+        mp_clear(&mp);
+        Tcl_DecrRefCount(magObj);
+        return Tclh_ErrorAllocation(rP->interp, "Memory", NULL);
+    }
+    /*
+     * The stubs table does not export mp_from_ubin on all versions, and
+     * shifting in a byte at a time with mp_mul_2d is quadratic in the
+     * length. So pack the big endian magnitude into digits directly
+     * starting from the least significant byte. Bits shifted beyond the
+     * accumulator are picked up again when the digit is emitted.
+     */
+    acc   = 0;
+    nbits = 0;
+    digit = 0;
+    for (i = len - 1; i >= 0; --i) {
+        acc |= (Tcl_WideUInt)magP[i] << nbits;
+        nbits += 8;
+        if (nbits >= MP_DIGIT_BIT) {
+            mp.dp[digit++] = (mp_digit)(acc & MP_MASK);
+            nbits -= MP_DIGIT_BIT;
+            acc = (Tcl_WideUInt)(magP[i] >> (8 - nbits));
+        }
+    }
+    if (nbits > 0)
+        mp.dp[digit++] = (mp_digit)(acc & MP_MASK);
+    TCLH_ASSERT(digit <= ndigits);
+    mp.used = (int)digit;
+    mp_clamp(&mp);
+    Tcl_DecrRefCount(magObj);
+
+    if (sign && mp.used != 0)
+        mp.sign = MP_NEG;
+    *objPP = Tcl_NewBignumObj(&mp);
+    return TCL_OK;
+}
+
+static Tclh_ReturnCode TclhDeserializeValue(TclhSerializeReader *rP,
+                                            Tcl_Obj **objPP);
+
+static Tclh_ReturnCode
+TclhDeserializeList(TclhSerializeReader *rP, Tcl_Obj **objPP)
+{
+    Tcl_Obj *listObj;
+    Tcl_Obj *elemObj;
+    Tcl_Size i, count;
+
+    /* Minimal element is a tag and a single byte */
+    TCLH_CHECK_RESULT(TclhDeserializeReadCount(rP, 2, &count));
+    /* For channels, do not trust count for preallocation */
+    listObj =
+        Tcl_NewListObj(rP->chan == NULL || count < 1024 ? count : 1024, NULL);
+    for (i = 0; i < count; ++i) {
+        if (TclhDeserializeValue(rP, &elemObj) != TCL_OK) {
+            Tcl_DecrRefCount(listObj);
+            return TCL_ERROR;
+        }
+        Tcl_ListObjAppendElement(NULL, listObj, elemObj);
+    }
+    *objPP = listObj;
+    return TCL_OK;
+}
+
+static Tclh_ReturnCode
+TclhDeserializeDict(TclhSerializeReader *rP, Tcl_Obj **objPP)
+{
+    Tcl_Obj *dictObj;
+    Tcl_Obj *keyObj;
+    Tcl_Obj *valueObj;
+    Tcl_Size i, count;
+
+    TCLH_CHECK_RESULT(TclhDeserializeReadCount(rP, 4, &count));
+    dictObj = Tcl_NewDictObj();
+    for (i = 0; i < count; ++i) {
+        if (TclhDeserializeValue(rP, &keyObj) != TCL_OK) {
+            Tcl_DecrRefCount(dictObj);
+            return TCL_ERROR;
+        }
+        /* Hold a reference in case the key is a duplicate and not stored */
+        Tcl_IncrRefCount(keyObj);
+        if (TclhDeserializeValue(rP, &valueObj) != TCL_OK) {
+            Tcl_DecrRefCount(keyObj);
+            Tcl_DecrRefCount(dictObj);
+            return TCL_ERROR;
+        }
+        Tcl_DictObjPut(NULL, dictObj, keyObj, valueObj);
+        Tcl_DecrRefCount(keyObj);
+    }
+    *objPP = dictObj;
+    return TCL_OK;
+}
+
+static Tclh_ReturnCode
+TclhDeserializeValue(TclhSerializeReader *rP, Tcl_Obj **objPP)
+{
+    unsigned char tag;
+    Tcl_WideUInt uwide;
+    Tcl_Size len;
+    Tclh_ReturnCode ret;
+
+    TCLH_CHECK_RESULT(TclhDeserializeRead(rP, &tag, 1));
+    switch (tag) {
+    case TCLH_SERIALIZE_STRING:
+    case TCLH_SERIALIZE_BYTES:
+        TCLH_CHECK_RESULT(TclhDeserializeReadCount(rP, 1, &len));
+        return TclhDeserializeChars(
+            rP, len, tag == TCLH_SERIALIZE_BYTES, objPP);
+    case TCLH_SERIALIZE_INT:
+        TCLH_CHECK_RESULT(TclhDeserializeReadVarint(rP, &uwide));
+        *objPP = Tclh_ObjSharedInt(
+            (Tcl_WideInt)(uwide >> 1) ^ -(Tcl_WideInt)(uwide & 1));
+        return TCL_OK;
+    case TCLH_SERIALIZE_DOUBLE:
+        {
+            double dval;
+            TCLH_CHECK_RESULT(TclhDeserializeReadUInt64(rP, &uwide));
+            memcpy(&dval, &uwide, sizeof(dval));
+            *objPP = Tcl_NewDoubleObj(dval);
+            return TCL_OK;
+        }
+    case TCLH_SERIALIZE_BIGNUM:
+        return TclhDeserializeBignum(rP, objPP);
+    case TCLH_SERIALIZE_LIST:
+    case TCLH_SERIALIZE_DICT:
+        if (rP->depth >= TCLH_SERIALIZE_MAX_DEPTH) {
+            return Tclh_ErrorGeneric(
+                rP->interp, "LIMIT", "Value nesting exceeds maximum depth.");
+        }
+        rP->depth++;
+        if (tag == TCLH_SERIALIZE_LIST)
+            ret = TclhDeserializeList(rP, objPP);
+        else
+            ret = TclhDeserializeDict(rP, objPP);
+        rP->depth--;
+        return ret;
+#ifdef TCLHWRAP_H
+    case TCLH_SERIALIZE_UUID:
+        {
+            Tclh_UUID uuid;
+            TCLH_CHECK_RESULT(TclhDeserializeRead(rP, &uuid, 16));
+            *objPP = Tclh_UuidWrap(&uuid);
+            return TCL_OK;
+        }
+#endif
+#ifdef TCLHPOINTER_H
+    case TCLH_SERIALIZE_POINTER:
+        {
+            unsigned char hasTag;
+            Tcl_Obj *tagObj = NULL;
+            TCLH_CHECK_RESULT(TclhDeserializeReadUInt64(rP, &uwide));
+            if (uwide > (Tcl_WideUInt)UINTPTR_MAX) {
+                return TclhDeserializeErrorFormat(
+                    rP, "Pointer value does not fit in address space.");
+            }
+            TCLH_CHECK_RESULT(TclhDeserializeRead(rP, &hasTag, 1));
+            if (hasTag) {
+                if (rP->depth >= TCLH_SERIALIZE_MAX_DEPTH) {
+                    return Tclh_ErrorGeneric(
+                        rP->interp,
+                        "LIMIT",
+                        "Value nesting exceeds maximum depth.");
+                }
+                rP->depth++;
+                ret = TclhDeserializeValue(rP, &tagObj);
+                rP->depth--;
+                TCLH_CHECK_RESULT(ret);
+                Tcl_IncrRefCount(tagObj);
+            }
+            *objPP = Tclh_PointerWrap((void *)(uintptr_t)uwide, tagObj);
+            if (tagObj)
+                Tcl_DecrRefCount(tagObj);
+            return TCL_OK;
+        }
+#endif
+    default:
+        return TclhDeserializeErrorFormat(
+            rP, "Unknown or unsupported value type in serialized data.");
+    }
+}
+
+static Tclh_ReturnCode
+TclhDeserializeTop(TclhSerializeReader *rP, Tcl_Obj **objPP)
+{
+    unsigned char version;
+    TCLH_ASSERT(gTclIntType);
+    TCLH_CHECK_RESULT(TclhDeserializeRead(rP, &version, 1));
+    if (version != TCLH_SERIALIZE_VERSION) {
+        return TclhDeserializeErrorFormat(
+            rP, "Unsupported serialization format version.");
+    }
+    return TclhDeserializeValue(rP, objPP);
+}
+
+Tclh_ReturnCode
+Tclh_ObjDeserialize(Tcl_Interp *interp,
+                    const void *bufP,
+                    Tcl_Size len,
+                    Tcl_Obj **objPP,
+                    Tcl_Size *usedP)
+{
+    TclhSerializeReader reader;
+    Tcl_Obj *objP;
+
+    memset(&reader, 0, sizeof(reader));
+    reader.interp = interp;
+    reader.p      = (const unsigned char *)bufP;
+    reader.end    = reader.p + len;
+
+    TCLH_CHECK_RESULT(TclhDeserializeTop(&reader, &objP));
+    if (usedP) {
+        *usedP = (Tcl_Size)(reader.p - (const unsigned char *)bufP);
+    }
+    else if (reader.p != reader.end) {
+        Tcl_IncrRefCount(objP);
+        Tcl_DecrRefCount(objP);
+        return TclhDeserializeErrorFormat(
+            &reader, "Extra data after serialized value.");
+    }
+    *objPP = objP;
+    return TCL_OK;
+}
+
+Tclh_ReturnCode
+Tclh_ObjDeserializeFromChannel(Tcl_Interp *interp,
+                               Tcl_Channel chan,
+                               Tcl_Obj **objPP)
+{
+    TclhSerializeReader reader;
+
+    memset(&reader, 0, sizeof(reader));
+    reader.interp = interp;
+    reader.chan   = chan;
+    return TclhDeserializeTop(&reader, objPP);
+}